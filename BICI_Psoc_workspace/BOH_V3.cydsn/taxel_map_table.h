@@ -0,0 +1,39 @@
+/* ========================================
+ *
+ * Copyright YOUR COMPANY, THE YEAR
+ * All Rights Reserved
+ * UNPUBLISHED, LICENSED SOFTWARE.
+ *
+ * CONFIDENTIAL AND PROPRIETARY INFORMATION
+ * WHICH IS THE PROPERTY OF your company.
+ *
+ * ========================================
+ *
+ * Summary:
+ *  Where the sensors of CapSense_dsRam go in sensorsList, in runs of
+ *  consecutive taxels (see Common/taxel_map.h). Included by main.h, after
+ *  project.h and taxel_map.h, and by host/taxel_map_test.c.
+ *
+ * ========================================
+*/
+
+#ifndef TAXEL_MAP_TABLE_H
+#define TAXEL_MAP_TABLE_H
+
+const TaxelMapRun taxelMap[] =
+{
+    TAXEL_MAP_RUN(CapSense_dsRam.snsList.row0,   11,   0),
+    TAXEL_MAP_RUN(CapSense_dsRam.snsList.row1,   11,  12),
+    TAXEL_MAP_RUN(CapSense_dsRam.snsList.row2,   11,  24),
+    TAXEL_MAP_RUN(CapSense_dsRam.snsList.row3,   11,  36),
+    TAXEL_MAP_RUN(CapSense_dsRam.snsList.row4,   11,  48),
+    TAXEL_MAP_RUN(CapSense_dsRam.snsList.row5,   11,  60),
+    TAXEL_MAP_RUN(CapSense_dsRam.snsList.row6,   11,  72),
+    TAXEL_MAP_RUN(CapSense_dsRam.snsList.row7,   11,  84),
+    TAXEL_MAP_RUN(CapSense_dsRam.snsList.row8,   11,  96),
+    TAXEL_MAP_RUN(CapSense_dsRam.snsList.row9,    6, 108),
+    TAXEL_MAP_RUN(CapSense_dsRam.snsList.row10,   4, 114)
+};
+
+#endif // TAXEL_MAP_TABLE_H
+/* [] END OF FILE */
@@ -0,0 +1,48 @@
+/* ========================================
+ *
+ * Copyright YOUR COMPANY, THE YEAR
+ * All Rights Reserved
+ * UNPUBLISHED, LICENSED SOFTWARE.
+ *
+ * CONFIDENTIAL AND PROPRIETARY INFORMATION
+ * WHICH IS THE PROPERTY OF your company.
+ *
+ * ========================================
+*/
+#include "taxel_map.h"
+
+/*******************************************************************************
+* PUBLIC FUNCTIONS
+*******************************************************************************/
+/*******************************************************************************
+* Function Name: taxel_map_copy
+********************************************************************************
+* Summary:
+*  Copy the raw counts of the sensors into the taxel list, run by run.
+*
+* Parameters:
+*  map: The runs of the board (see TAXEL_MAP_RUN()).
+*  nbRuns: The number of runs in 'map'.
+*  taxels: The taxel list. Must hold every index the runs write.
+*
+* Return:
+*  None.
+*
+*******************************************************************************/
+void taxel_map_copy(const TaxelMapRun *map, uint8_t nbRuns, uint16_t *taxels)
+{
+    for(const TaxelMapRun *run = map; run < map + nbRuns; run++)
+    {
+        const uint8_t *sensor = (const uint8_t *)run->first;
+        uint16_t *taxel = taxels + run->output;
+        uint16_t *end = taxel + run->count;
+        
+        while(taxel < end)
+        {
+            *taxel++ = *(const uint16_t *)sensor;
+            sensor += run->stride;
+        }
+    }
+}
+
+/* [] END OF FILE */
@@ -0,0 +1,65 @@
+/* ========================================
+ *
+ * Copyright YOUR COMPANY, THE YEAR
+ * All Rights Reserved
+ * UNPUBLISHED, LICENSED SOFTWARE.
+ *
+ * CONFIDENTIAL AND PROPRIETARY INFORMATION
+ * WHICH IS THE PROPERTY OF your company.
+ *
+ * ========================================
+ *
+ * Summary:
+ *  Copy of the raw counts of a CapSense scan into the taxel list sent to the
+ *  hub, shared by all the sensor nodes. Each board describes where its
+ *  sensors go with a const table of runs: the sensors of a widget (or part
+ *  of one) and the index of the first one in the taxel list. The following
+ *  sensors of the run go to the following indexes. Taxels that no run
+ *  covers are left untouched.
+ *
+ *  Plain C99 without PSoC headers, so it also builds on the host.
+ *
+ * Usage (main.h of a node):
+ *  const TaxelMapRun taxelMap[] = {
+ *      TAXEL_MAP_RUN(CapSense_dsRam.snsList.row0, 11, 0),
+ *      TAXEL_MAP_RUN(CapSense_dsRam.snsList.row1, 11, 12),
+ *  };
+ *  taxel_map_copy(taxelMap, TAXEL_MAP_SIZE(taxelMap), taxels);
+ *
+ * ========================================
+*/
+
+#ifndef TAXEL_MAP_H
+#define TAXEL_MAP_H
+
+#include <stdint.h>
+
+/*******************************************************************************
+* MACROS
+*******************************************************************************/
+// Run of 'count' sensors of a CapSense_dsRam.snsList widget array, starting
+// at its first sensor and copied to the taxels from index 'output'
+#define TAXEL_MAP_RUN(sensors, count, output) \
+    {&(sensors)[0].raw[0], sizeof((sensors)[0]), (count), (output)}
+
+// Number of runs of a table
+#define TAXEL_MAP_SIZE(map) ((uint8_t)(sizeof(map) / sizeof((map)[0])))
+
+/*******************************************************************************
+* PUBLIC TYPES
+*******************************************************************************/
+typedef struct
+{
+    const uint16_t *first;  // Raw count of the first sensor of the run
+    uint8_t stride;         // Bytes from a sensor to the next one
+    uint8_t count;          // Number of sensors in the run
+    uint8_t output;         // Taxel index of the first sensor
+} TaxelMapRun;
+
+/*******************************************************************************
+* PUBLIC PROTOTYPES
+*******************************************************************************/
+void taxel_map_copy(const TaxelMapRun *map, uint8_t nbRuns, uint16_t *taxels);
+
+#endif // TAXEL_MAP_H
+/* [] END OF FILE */
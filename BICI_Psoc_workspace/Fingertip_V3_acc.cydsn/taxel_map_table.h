@@ -0,0 +1,41 @@
+/* ========================================
+ *
+ * Copyright YOUR COMPANY, THE YEAR
+ * All Rights Reserved
+ * UNPUBLISHED, LICENSED SOFTWARE.
+ *
+ * CONFIDENTIAL AND PROPRIETARY INFORMATION
+ * WHICH IS THE PROPERTY OF your company.
+ *
+ * ========================================
+ *
+ * Summary:
+ *  Where the sensors of CapSense_dsRam go in sensorsList, in runs of
+ *  consecutive taxels (see Common/taxel_map.h). Included by main.h, after
+ *  project.h and taxel_map.h, and by host/taxel_map_test.c.
+ *
+ * ========================================
+*/
+
+#ifndef TAXEL_MAP_TABLE_H
+#define TAXEL_MAP_TABLE_H
+
+const TaxelMapRun taxelMap[] =
+{
+    TAXEL_MAP_RUN(CapSense_dsRam.snsList.row0,    9,   0),
+    TAXEL_MAP_RUN(CapSense_dsRam.snsList.row1,    9,   9),
+    TAXEL_MAP_RUN(CapSense_dsRam.snsList.row2,    7,  18),
+    TAXEL_MAP_RUN(CapSense_dsRam.snsList.row3,    5,  25),
+    TAXEL_MAP_RUN(CapSense_dsRam.snsList.row4,    4,  30),
+    TAXEL_MAP_RUN(CapSense_dsRam.snsList.row5,    4,  34),
+    TAXEL_MAP_RUN(CapSense_dsRam.snsList.row6,    4,  38),
+    TAXEL_MAP_RUN(CapSense_dsRam.snsList.row7,    4,  42),
+    TAXEL_MAP_RUN(CapSense_dsRam.snsList.row8,    4,  46),
+    TAXEL_MAP_RUN(CapSense_dsRam.snsList.row9,    4,  50),
+    TAXEL_MAP_RUN(CapSense_dsRam.snsList.row10,   4,  54),
+    TAXEL_MAP_RUN(CapSense_dsRam.snsList.row11,   4,  58),
+    TAXEL_MAP_RUN(CapSense_dsRam.snsList.row12,   4,  62)
+};
+
+#endif // TAXEL_MAP_TABLE_H
+/* [] END OF FILE */
@@ -0,0 +1,36 @@
+/* ========================================
+ *
+ * Copyright YOUR COMPANY, THE YEAR
+ * All Rights Reserved
+ * UNPUBLISHED, LICENSED SOFTWARE.
+ *
+ * CONFIDENTIAL AND PROPRIETARY INFORMATION
+ * WHICH IS THE PROPERTY OF your company.
+ *
+ * ========================================
+ *
+ * Summary:
+ *  Where the sensors of CapSense_dsRam go in sensorsList, in runs of
+ *  consecutive taxels (see Common/taxel_map.h). Included by main.h, after
+ *  project.h and taxel_map.h, and by host/taxel_map_test.c.
+ *
+ * ========================================
+*/
+
+#ifndef TAXEL_MAP_TABLE_H
+#define TAXEL_MAP_TABLE_H
+
+const TaxelMapRun taxelMap[] =
+{
+    TAXEL_MAP_RUN(CapSense_dsRam.snsList.row0,   4,   0),
+    TAXEL_MAP_RUN(CapSense_dsRam.snsList.row1,   4,   4),
+    TAXEL_MAP_RUN(CapSense_dsRam.snsList.row2,   6,   8),
+    TAXEL_MAP_RUN(CapSense_dsRam.snsList.row3,   3,  14),
+    TAXEL_MAP_RUN(CapSense_dsRam.snsList.row4,   3,  17),
+    TAXEL_MAP_RUN(CapSense_dsRam.snsList.row5,   5,  20),
+    TAXEL_MAP_RUN(CapSense_dsRam.snsList.row6,   4,  25),
+    TAXEL_MAP_RUN(CapSense_dsRam.snsList.row7,   1,  29)
+};
+
+#endif // TAXEL_MAP_TABLE_H
+/* [] END OF FILE */
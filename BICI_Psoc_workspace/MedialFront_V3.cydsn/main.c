@@ -11,21 +11,115 @@
 */
 #include <main.h>
 
-void copyDataToI2CBuffer()
-{                  
-    for(unsigned int i=0; i<4; ++i) // Rows0-2
+void processCommand(uint8 command)
+{
+    switch(command)
+    {
+        case (CMD_START_SCAN):
+            /* Scan on the hub trigger only, so all nodes sample together */
+            triggeredMode = true;
+            scanRequested = true;
+        break;
+        case (CMD_FREE_RUN):
+            triggeredMode = false;
+        break;
+        case (CMD_GET_DESCRIPTOR):
+            descriptorRequested = true;
+        break;
+    }
+}
+
+/* Index of the FIFO entry 'offset' entries after 'index' (offset at most
+*  SCAN_FIFO_DEPTH), without a division */
+uint8 fifoIndex(uint8 index, uint8 offset)
+{
+    index += offset;
+    return (index >= SCAN_FIFO_DEPTH) ? (index - SCAN_FIFO_DEPTH) : index;
+}
+
+/* Capture the scan CapSense_ProcessAllWidgets() just finished into the FIFO
+*  entry after the scans waiting for the hub, outside of any critical section:
+*  the hub only reads those. When the FIFO is full, the oldest scan makes room
+*  for it, unless the hub is reading the oldest scan: the new one is dropped
+*  then. Either way the hub sees the loss in the sequence numbers.
+*  Returns true if the scan was captured. */
+bool captureScan()
+{
+    bool captured = true;
+    
+    scanSequence++;
+    uint8 state = CyEnterCriticalSection();
+    if(fifoCount == SCAN_FIFO_DEPTH)
+    {
+        if(pinnedCount > 0u)
+        {
+            captured = false;
+        }
+        else
+        {
+            fifoFirst = fifoIndex(fifoFirst, 1u);
+            fifoCount--;
+        }
+    }
+    SensorStruct* snapshot = &scanFifo[fifoIndex(fifoFirst, fifoCount)];
+    CyExitCriticalSection(state);
+    if(!captured)
+    {
+        return false;
+    }
+    
+    taxel_map_copy(taxelMap, TAXEL_MAP_SIZE(taxelMap), snapshot->sensorsList);
+    snapshot->layoutVersion = REGISTER_LAYOUT_VERSION;
+    snapshot->scanSequence = scanSequence;
+    snapshot->scanDuration = scanDuration;
+    snapshot->counterTimer = scanTimer;
+    return true;
+}
+
+/* Make the last captured scan available to the hub, at the end of the FIFO.
+*  A read in progress keeps the scans it started with. */
+void publishScan()
+{
+    uint8 state = CyEnterCriticalSection();
+    if(newScanAvailable)
+    {
+        fifoCount++;
+        newScanAvailable = false;
+    }
+    CyExitCriticalSection(state);
+}
+
+/* Take the scans the hub read entirely off the FIFO once a scan read ended,
+*  from the byte count latched by I2C_I2C_ISR_ExitCallback(). Called by the
+*  main loop, and by AddressAccepted() before it pins the scans again. */
+void releaseScans()
+{
+    uint8 state = CyEnterCriticalSection();
+    if(scanReadDone)
     {
-        sensorStruct.sensorsList[i] = CapSense_dsRam.snsList.row0[i].raw[0]; 
-        sensorStruct.sensorsList[i+4] = CapSense_dsRam.snsList.row1[i].raw[0];
-        sensorStruct.sensorsList[i+8] = CapSense_dsRam.snsList.row2[i].raw[0];
+        uint32 nbRead = scanBytesRead / sizeof(SensorStruct);
+        if(nbRead > pinnedCount)
+        {
+            nbRead = pinnedCount;
+        }
+        fifoFirst = fifoIndex(fifoFirst, (uint8)nbRead);
+        fifoCount -= (uint8)nbRead;
+        pinnedCount = 0;
+        scanReadDone = false;
     }
-    for(unsigned int i=0; i<3; ++i) // Row3-7
+    CyExitCriticalSection(state);
+}
+
+/* Runs at the end of each I2C slave interrupt. When a read of the pinned
+*  scans completes, latch the bytes the hub got there, before the next
+*  transaction sets up the read buffer again. */
+void I2C_I2C_ISR_ExitCallback(void)
+{
+    if(scanReadPending && 0u != (I2C_I2CSlaveStatus() & I2C_I2C_SSTAT_RD_CMPLT))
     {
-        sensorStruct.sensorsList[i+12] = CapSense_dsRam.snsList.row3[i].raw[0];
-        sensorStruct.sensorsList[i+15] = CapSense_dsRam.snsList.row4[i].raw[0];
-        sensorStruct.sensorsList[i+18] = CapSense_dsRam.snsList.row5[i].raw[0];
-        sensorStruct.sensorsList[i+21] = CapSense_dsRam.snsList.row6[i].raw[0];
-        sensorStruct.sensorsList[i+24] = CapSense_dsRam.snsList.row7[i].raw[0];
+        scanBytesRead = I2C_I2CSlaveGetReadBufSize();
+        scanReadPending = false;
+        scanReadDone = true;
     }
 }
 
@@ -37,12 +131,53 @@ uint32 AddressAccepted(void)
     switch(activeAddress)
     {
         case (I2C_SLAVE_ADDRESS1):
-            /* Address 1: Setup buffers for read and write */
-            if(sensorStruct.dataReady == DATA_READY)
+            /* Address 1: Setup buffers for read and write. Nothing is
+            *  copied here, so the address is acknowledged without stretching
+            *  SCL. The read buffer is only set up when the hub reads: a
+            *  command write pins no scan. Answer the descriptor once when
+            *  the hub asked for it */
+            if(I2C_CHECK_I2C_STATUS(I2C_I2C_STATUS_S_READ))
             {
-                copyDataToI2CBuffer();
+                if(descriptorRequested)
+                {
+                    descriptorRequested = false;
+                    I2C_I2CSlaveInitReadBuf ((uint8 *)&nodeDescriptor, sizeof(nodeDescriptor));
+                }
+                else
+                {
+                    /* The scans from the oldest one to the end of the array
+                    *  are read in one transfer, and stay pinned until the
+                    *  read completes. The scans of the last read go first,
+                    *  and the completion of that read is cleared so it isn't
+                    *  taken for the end of this one */
+                    releaseScans();
+                    I2C_I2CSlaveClearReadStatus();
+                    pinnedCount = SCAN_FIFO_DEPTH - fifoFirst;
+                    if(pinnedCount > fifoCount)
+                    {
+                        pinnedCount = fifoCount;
+                    }
+                    if(pinnedCount > 0u)
+                    {
+                        scanFifo[fifoFirst].scansReady = pinnedCount;
+                        scanReadPending = true;
+                        I2C_I2CSlaveInitReadBuf ((uint8 *)&scanFifo[fifoFirst], pinnedCount * sizeof(SensorStruct));
+                    }
+                    else
+                    {
+                        I2C_I2CSlaveInitReadBuf (noScanHeader, sizeof(noScanHeader));
+                    }
+                }
             }
-            I2C_I2CSlaveInitReadBuf ((uint8 *)&sensorStruct, sizeof(sensorStruct));
+            I2C_I2CSlaveInitWriteBuf(commandBuffer, CMD_BUFFER_SIZE);
+        break;
+        case (I2C_GENERAL_CALL_ADDRESS):
+            /* General call: command sent to all nodes. The scan finished
+            *  before this trigger is published by the main loop right away,
+            *  so the hub reads the scans of all nodes taken at the same
+            *  instant */
+            publishRequested = true;
+            I2C_I2CSlaveInitWriteBuf(commandBuffer, CMD_BUFFER_SIZE);
         break;
         case (I2C_SLAVE_ADDRESS2):
             /* Address 2: Setup buffers for read and write */
@@ -55,9 +190,6 @@ uint32 AddressAccepted(void)
 
 int main(void)
 {    
-    sensorStruct.dataReady = DATA_NOT_READY;
-    sensorStruct.counterTimer = 0x0000;
-    
     I2C_Start();
     I2C_I2CSlaveSetAddress(I2C_SLAVE_ADDRESS1);
     I2C_SetI2cAddressCustomInterruptHandler(&AddressAccepted);
@@ -68,47 +200,82 @@ int main(void)
     __enable_irq(); /* Enable global interrupts. */
     
     CapSense_Start();
+    scanStartCount = Timer_ReadCounter();
     CapSense_ScanAllWidgets();
+    scanInProgress = true;
     
     for(;;)
     {
         /* Read complete*/
         if (0u != (I2C_I2CSlaveStatus() & I2C_I2C_SSTAT_RD_CMPLT))
         {
-            /* Clear the slave read buffer and status */
-            I2C_I2CSlaveClearReadBuf();
+            /* Only the status is cleared: the read buffer is set up again
+            *  on each address, and the next read may already use it */
             I2C_I2CSlaveClearReadStatus();
-            if(activeAddress == I2C_SLAVE_ADDRESS1)
-            {
-                sensorStruct.dataReady = DATA_NOT_READY;
-            }
         }
         
+        /* Scan read complete, with the byte count latched by the slave
+        *  interrupt */
+        releaseScans();
+        
         /* Write complete*/
         if (0u != (I2C_I2CSlaveStatus() & I2C_I2C_SSTAT_WR_CMPLT))
         {
+            /* Command from the hub */
+            if((activeAddress == I2C_SLAVE_ADDRESS1 || activeAddress == I2C_GENERAL_CALL_ADDRESS)
+                && I2C_I2CSlaveGetWriteBufSize() > 0u)
+            {
+                processCommand(commandBuffer[0]);
+            }
+            
             /* Clean-up status and buffer pointer */
             I2C_I2CSlaveClearWriteBuf();
             I2C_I2CSlaveClearWriteStatus();
         }
         
+        /* Publish the last scan: on the hub trigger in triggered mode, as
+        *  soon as it is done otherwise */
+        if(publishRequested || !triggeredMode)
+        {
+            publishScan();
+            publishRequested = false;
+        }
+        
         /* Do this only when a scan is done */
         if(CapSense_NOT_BUSY == CapSense_IsBusy())
         {
-            /* Process all widgets */
-            CapSense_ProcessAllWidgets();
-            sensorStruct.dataReady = DATA_READY;
-            sensorStruct.counterTimer += Timer_ReadCounter();
-            Timer_WriteCounter(0);
-            
-            /* To sync with Tuner application */
-            CapSense_RunTuner();
+            if(scanInProgress)
+            {
+                /* Process all widgets */
+                scanDuration = Timer_ReadCounter() - scanStartCount;
+                CapSense_ProcessAllWidgets();
+                scanTimer += Timer_ReadCounter();
+                Timer_WriteCounter(0);
+                newScanAvailable = captureScan();
+                scanInProgress = false;
+                
+                /* To sync with Tuner application */
+                CapSense_RunTuner();
+            }
             
-            /* Start next scan */
-            CapSense_ScanAllWidgets();
+            /* Start next scan: right away, or on the hub trigger in triggered mode */
+            if(!triggeredMode || scanRequested)
+            {
+                /* In triggered mode, a scan that finished after its trigger
+                *  is published before the next one is captured over it */
+                if(triggeredMode)
+                {
+                    publishScan();
+                }
+                scanRequested = false;
+                scanStartCount = Timer_ReadCounter();
+                CapSense_ScanAllWidgets();
+                scanInProgress = true;
+            }
         }
         
     }
+    
 }
 
 /* [] END OF FILE */
@@ -16,6 +16,9 @@
     /*Define your macro callbacks here */
     /*For more information, refer to the Writing Code topic in the PSoC Creator Help.*/
 
+    /* End of the scan reads, see main.c */
+    #define I2C_I2C_ISR_EXIT_CALLBACK
+    void I2C_I2C_ISR_ExitCallback(void);
     
 #endif /* CYAPICALLBACKS_H */   
 /* [] */
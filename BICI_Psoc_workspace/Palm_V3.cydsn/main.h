@@ -12,21 +12,106 @@
 
 #include "project.h"
 #include <stdbool.h>
+#include <stddef.h>
+#include "taxel_map.h"
+#include "taxel_map_table.h"
 
 #define TAXEL_COUNT         (121)
 #define I2C_SLAVE_ADDRESS1  (0x15u)
 #define I2C_SLAVE_ADDRESS2  (I2C_SLAVE_ADDRESS1+(0x40u))
-#define DATA_READY          (0x01)
 #define DATA_NOT_READY      (0x00)
 
+/* The hub first reads only the header of SensorStruct (scans ready, layout
+*  version and scan sequence number), and reads the scans only when a new one
+*  is available, as many as it can in one transfer. The scans read entirely
+*  leave the FIFO. */
+#define READY_HEADER_SIZE   (4u)
+
+/* Commands written by the hub, either to I2C_SLAVE_ADDRESS1 or to all nodes
+*  at once with an I2C general call ("Accept general call" must be enabled in
+*  the I2C component). */
+#define I2C_GENERAL_CALL_ADDRESS (0x00u)
+#define CMD_BUFFER_SIZE     (4u)
+#define CMD_START_SCAN      (0x01u) /* Start one scan, enter triggered mode */
+#define CMD_FREE_RUN        (0x02u) /* Leave triggered mode, scan continuously */
+#define CMD_GET_DESCRIPTOR  (0x03u) /* Next read returns nodeDescriptor */
+
+/* Descriptor read by the hub when it enumerates the bus, so it doesn't need
+*  to know the nodes in advance. Sensor types are listed in SensorHub_V3
+*  main.h. REGISTER_LAYOUT_VERSION is the layout of SensorStruct. */
+#define DESCRIPTOR_MAGIC    (0xB1u)
+#define SENSOR_TYPE         (0x08u) /* Palm */
+#define FIRMWARE_VERSION    (0x03u)
+#define REGISTER_LAYOUT_VERSION (0x03u)
+
+/* Scans kept for the hub, so it can be late by SCAN_FIFO_DEPTH - 1 scans
+*  without losing any. Each one takes sizeof(SensorStruct) of RAM. */
+#define SCAN_FIFO_DEPTH     (3u)
+
+/* Capabilities of the node, in its descriptor. I2C_CAP_FAST_PLUS requires the
+*  I2C component to be set to a 1000 kbps data rate; the hub falls back to
+*  400 kHz by itself if the node doesn't keep up. */
+#define I2C_CAP_FAST_PLUS   (0x01u)
+#define NODE_CAPABILITIES   (I2C_CAP_FAST_PLUS)
+
+/* Registers read by the hub, little endian. Each field is aligned on its
+*  size, so the layout has no padding whatever the compiler: the taxels start
+*  at byte 12 (checked below). */
 typedef struct
 {
-    uint8 dataReady;
+    uint8 scansReady;       /* Scans readable from this one on, set when a read starts */
+    uint8 layoutVersion;    /* REGISTER_LAYOUT_VERSION */
+    uint16 scanSequence;    /* Incremented each time a new scan is published */
+    uint32 scanDuration;    /* Timer ticks from the start to the end of the scan */
     uint32 counterTimer;
     uint16 sensorsList[TAXEL_COUNT];    
 } SensorStruct;
 
-SensorStruct sensorStruct;
+typedef char sensorStructLayoutCheck[(offsetof(SensorStruct, scanSequence) == 2u &&
+    offsetof(SensorStruct, counterTimer) == 8u &&
+    offsetof(SensorStruct, sensorsList) == 12u) ? 1 : -1];
+
+typedef struct
+{
+    uint8 magic;
+    uint8 layoutVersion;
+    uint16 taxelCount;
+    uint8 sensorType;
+    uint8 firmwareVersion;
+    uint8 capabilities;
+    uint8 scanFifoDepth;
+    uint16 recordSize;      /* sizeof(SensorStruct): scans of a read are this far apart */
+} NodeDescriptor;
+
+typedef char nodeDescriptorLayoutCheck[(offsetof(NodeDescriptor, recordSize) == 8u) ? 1 : -1];
+
+/* Scans not read by the hub yet, oldest first: scanFifo[fifoFirst] and the
+*  (fifoCount - 1) next ones, wrapping around. The next scan is captured into
+*  the entry after them, and published by counting it. A read gets the scans
+*  from the oldest one to the end of the array, so they are contiguous. */
+SensorStruct scanFifo[SCAN_FIFO_DEPTH];
+uint8 fifoFirst = 0;
+uint8 fifoCount = 0;
+uint8 pinnedCount = 0;      /* Scans given to the read in progress */
+uint16 scanSequence = 0;    /* Scans finished, lost ones included */
+uint8 noScanHeader[READY_HEADER_SIZE] = {DATA_NOT_READY, REGISTER_LAYOUT_VERSION, 0, 0};
+uint32 scanTimer = 0;
+uint32 scanStartCount = 0; /* Timer counter when the scan started */
+uint32 scanDuration = 0;
+const NodeDescriptor nodeDescriptor =
+    {DESCRIPTOR_MAGIC, REGISTER_LAYOUT_VERSION, TAXEL_COUNT, SENSOR_TYPE, FIRMWARE_VERSION,
+     NODE_CAPABILITIES, SCAN_FIFO_DEPTH, sizeof(SensorStruct)};
+bool descriptorRequested = false;
+bool scanReadPending = false;  /* The read in progress is on the pinned scans */
+bool scanReadDone = false;     /* A scan read ended, its scans are not released yet */
+uint32 scanBytesRead = 0;      /* Bytes the hub got in that read */
 uint8 activeAddress = 0xFF;
 
-/* [] END OF FILE */
\ No newline at end of file
+uint8 commandBuffer[CMD_BUFFER_SIZE];
+bool triggeredMode = false;
+bool scanRequested = false;
+bool scanInProgress = false;
+bool newScanAvailable = false;
+bool publishRequested = false;
+
+/* [] END OF FILE */
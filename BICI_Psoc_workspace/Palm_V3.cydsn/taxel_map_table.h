@@ -0,0 +1,33 @@
+/* ========================================
+ *
+ * Copyright YOUR COMPANY, THE YEAR
+ * All Rights Reserved
+ * UNPUBLISHED, LICENSED SOFTWARE.
+ *
+ * CONFIDENTIAL AND PROPRIETARY INFORMATION
+ * WHICH IS THE PROPERTY OF your company.
+ *
+ * ========================================
+ *
+ * Summary:
+ *  Where the sensors of CapSense_dsRam go in sensorsList, in runs of
+ *  consecutive taxels (see Common/taxel_map.h). Included by main.h, after
+ *  project.h and taxel_map.h, and by host/taxel_map_test.c.
+ *
+ * ========================================
+*/
+
+#ifndef TAXEL_MAP_TABLE_H
+#define TAXEL_MAP_TABLE_H
+
+const TaxelMapRun taxelMap[] =
+{
+    TAXEL_MAP_RUN(CapSense_dsRam.snsList.touchpad0,       66,   0),
+    TAXEL_MAP_RUN(CapSense_dsRam.snsList.touchpad1,       42,  66),
+    TAXEL_MAP_RUN(CapSense_dsRam.snsList.matrixbuttons0,   4, 108),
+    TAXEL_MAP_RUN(CapSense_dsRam.snsList.matrixbuttons1,   4, 112),
+    TAXEL_MAP_RUN(CapSense_dsRam.snsList.button0,          5, 116)
+};
+
+#endif // TAXEL_MAP_TABLE_H
+/* [] END OF FILE */
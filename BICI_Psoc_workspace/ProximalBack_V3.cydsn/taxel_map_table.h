@@ -0,0 +1,39 @@
+/* ========================================
+ *
+ * Copyright YOUR COMPANY, THE YEAR
+ * All Rights Reserved
+ * UNPUBLISHED, LICENSED SOFTWARE.
+ *
+ * CONFIDENTIAL AND PROPRIETARY INFORMATION
+ * WHICH IS THE PROPERTY OF your company.
+ *
+ * ========================================
+ *
+ * Summary:
+ *  Where the sensors of CapSense_dsRam go in sensorsList, in runs of
+ *  consecutive taxels (see Common/taxel_map.h). Included by main.h, after
+ *  project.h and taxel_map.h, and by host/taxel_map_test.c.
+ *
+ * ========================================
+*/
+
+#ifndef TAXEL_MAP_TABLE_H
+#define TAXEL_MAP_TABLE_H
+
+const TaxelMapRun taxelMap[] =
+{
+    TAXEL_MAP_RUN(CapSense_dsRam.snsList.row0,   10,   0),
+    TAXEL_MAP_RUN(CapSense_dsRam.snsList.row1,    9,  10),
+    TAXEL_MAP_RUN(CapSense_dsRam.snsList.row2,    9,  19),
+    TAXEL_MAP_RUN(CapSense_dsRam.snsList.row3,   11,  28),
+    TAXEL_MAP_RUN(CapSense_dsRam.snsList.row4,   11,  39),
+    TAXEL_MAP_RUN(CapSense_dsRam.snsList.row5,    6,  50),
+    TAXEL_MAP_RUN(CapSense_dsRam.snsList.row6,    6,  56),
+    TAXEL_MAP_RUN(CapSense_dsRam.snsList.row7,    4,  62),
+    TAXEL_MAP_RUN(CapSense_dsRam.snsList.row8,    4,  66),
+    TAXEL_MAP_RUN(CapSense_dsRam.snsList.row9,    4,  70),
+    TAXEL_MAP_RUN(CapSense_dsRam.snsList.row10,   4,  74)
+};
+
+#endif // TAXEL_MAP_TABLE_H
+/* [] END OF FILE */
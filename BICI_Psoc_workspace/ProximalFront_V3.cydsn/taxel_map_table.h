@@ -0,0 +1,38 @@
+/* ========================================
+ *
+ * Copyright YOUR COMPANY, THE YEAR
+ * All Rights Reserved
+ * UNPUBLISHED, LICENSED SOFTWARE.
+ *
+ * CONFIDENTIAL AND PROPRIETARY INFORMATION
+ * WHICH IS THE PROPERTY OF your company.
+ *
+ * ========================================
+ *
+ * Summary:
+ *  Where the sensors of CapSense_dsRam go in sensorsList, in runs of
+ *  consecutive taxels (see Common/taxel_map.h). Included by main.h, after
+ *  project.h and taxel_map.h, and by host/taxel_map_test.c.
+ *
+ * ========================================
+*/
+
+#ifndef TAXEL_MAP_TABLE_H
+#define TAXEL_MAP_TABLE_H
+
+const TaxelMapRun taxelMap[] =
+{
+    TAXEL_MAP_RUN(CapSense_dsRam.snsList.row0,  11,   0),
+    TAXEL_MAP_RUN(CapSense_dsRam.snsList.row1,  11,  11),
+    TAXEL_MAP_RUN(CapSense_dsRam.snsList.row2,  11,  22),
+    TAXEL_MAP_RUN(CapSense_dsRam.snsList.row3,   6,  33),
+    TAXEL_MAP_RUN(CapSense_dsRam.snsList.row4,   6,  39),
+    TAXEL_MAP_RUN(CapSense_dsRam.snsList.row5,   4,  45),
+    TAXEL_MAP_RUN(CapSense_dsRam.snsList.row6,   4,  49),
+    TAXEL_MAP_RUN(CapSense_dsRam.snsList.row7,   4,  53),
+    TAXEL_MAP_RUN(CapSense_dsRam.snsList.row8,   4,  57),
+    TAXEL_MAP_RUN(CapSense_dsRam.snsList.row9,   4,  61)
+};
+
+#endif // TAXEL_MAP_TABLE_H
+/* [] END OF FILE */
@@ -32,17 +32,19 @@
 *******************************************************************************/
 
 #include "comm_driver.h"
-#include "ringbuf.h"
+#include "cyapicallbacks.h"
+#include "spsc_ring.h"
 
 // Verification
-#if USE_USBUART || USE_UART
-    #if CYDEV_HEAP_SIZE < (RX_BUFFER_SIZE + TX_BUFFER_SIZE + 2)
-        #error Invalid HEAP size! You need at least (RX_BUFFER_SIZE + TX_BUFFER_SIZE + 2) bytes for comm_driver
-    #endif
+#if (TX_BLOCK_QUEUE_SIZE & (TX_BLOCK_QUEUE_SIZE - 1u)) != 0u
+    #error TX_BLOCK_QUEUE_SIZE must be a power of two
 #endif
 #if !USE_USBUART && !USE_UART
     #warning Both USE_USBUART and USE_UART are set to '0'
 #endif
+#if COMM_EVENT_DRIVEN && (COMM_UART_RX_BUFFER_SIZE > COMM_FIFO_SIZE || COMM_UART_TX_BUFFER_SIZE > COMM_FIFO_SIZE)
+    #error The COMM component must not use software buffers (RX/TX buffer size = FIFO depth) with an internal interrupt
+#endif
     
 // TX specific macros
 #if USE_USBUART
@@ -53,6 +55,21 @@
     #define COMM_TX_MAX_PACKET_SIZE (0u)
 #endif
 #define TX_MAX_REJECT (8u)
+#define TX_BLOCK_QUEUE_MASK (TX_BLOCK_QUEUE_SIZE - 1u)
+
+// The TX interrupt fires when the COMM FIFO holds less than this many bytes
+#define COMM_TX_FIFO_LEVEL (COMM_FIFO_SIZE / 2u)
+
+// RX macros
+// Without a software buffer in the COMM component, its RX FIFO is read
+// straight from the SCB registers
+#if USE_UART && (COMM_UART_RX_BUFFER_SIZE <= COMM_FIFO_SIZE)
+    #define RX_FIFO_COUNT() (COMM_GET_RX_FIFO_ENTRIES)
+    #define RX_FIFO_READ() ((uint8)(COMM_RX_FIFO_RD_REG & 0xFF))
+#elif USE_UART
+    #define RX_FIFO_COUNT() (COMM_SpiUartGetRxBufferSize())
+    #define RX_FIFO_READ() ((uint8)(COMM_SpiUartReadRxData() & 0xFF))
+#endif
 
 // Interrupt macros
 #if CY_PSOC5LP
@@ -66,14 +83,40 @@
 /*******************************************************************************
 * PRIVATE VARIABLES
 *******************************************************************************/
-// Buffer to copy bytes from communication block into FIFO buffers
+#if USE_USBUART
+// Buffer to copy bytes from the USBUART when they wrap in the RX FIFO buffer
 uint8 _tempBuffer[COMM_TX_MAX_PACKET_SIZE];
+#endif
+
+// The FIFO buffers are shared by the main loop and the comm interrupt
+// without disabling the interrupts: the comm interrupt is the only producer
+// of the RX buffer and the only consumer of the TX buffer.
 
 // RX buffer
-ringbuf_t _rxBuffer; // Circular buffer for RX operations
+SPSC_RING_DEFINE(_rxBuffer, RX_BUFFER_SIZE); // Circular buffer for RX operations
+comm_rx_stats_t _rxStats; // RX counters written by the comm interrupt,
+                          // message counters by comm_getmsg()
+#ifdef _COMM_DRIVER_MSG_H
+uint8 _rxMsgLength = 0; // MSG_LENGTH of the message at the front of the RX
+                        // buffer, 0 until its header is checked
+#endif
 
 // TX buffer
-ringbuf_t _txBuffer; // Circular buffer for TX operations
+SPSC_RING_DEFINE(_txBuffer, TX_BUFFER_SIZE); // Circular buffer for TX operations
+
+// In-place TX messages, sent straight from the caller's buffer. The queue
+// indexes run freely: _txBlockIn is only written by the main loop and
+// _txBlockOut by the comm interrupt.
+typedef struct {
+    const uint8 *data;
+    uint16 count;
+    uint32 ringMark; // _txBuffer.head when queued: ring bytes to send first
+    bool droppable;  // Whole message, can be withdrawn until it starts
+} _txBlock_t;
+_txBlock_t _txBlocks[TX_BLOCK_QUEUE_SIZE];
+volatile uint8 _txBlockIn = 0;
+volatile uint8 _txBlockOut = 0;
+uint16 _txBlockSent = 0; // Bytes of the oldest block already sent
 #if USE_USBUART
 bool _txZlpRequired = false; // Flag to indicate the ZLP is required
 uint8 _txReject = 0; // The count of trial rejected by the TX endpoint
@@ -88,16 +131,47 @@ void _init_cdc(bool first_init);
 #endif
 void _comm_rx_isr();
 void _comm_tx_isr();
+void _comm_rx_resume();
+#ifdef _COMM_DRIVER_MSG_H
+void _comm_rx_discard(uint32 count);
+#endif
+void _comm_tx_write(const void *data, uint16 count);
+#ifdef _COMM_DRIVER_MSG_H
+uint16 _comm_msgv_length(const comm_iovec_t *iov, uint8 n);
+void _comm_tx_write_msgv(const comm_iovec_t *iov, uint8 n, uint16 count);
+#endif
+void _comm_tx_reserve(uint16 count);
+void _comm_tx_queue_block(const uint8 *data, uint16 count, bool droppable);
+uint16 _comm_tx_next_chunk(const uint8 **chunk, uint16 max_count);
 
 
 /*******************************************************************************
 * INTERRUPTS
 *******************************************************************************/
 // Must be placed after the functions prototypes (or after their definition)
+#if COMM_EVENT_DRIVEN
+CY_ISR(int_comm_isr) {
+    // Take the RX bytes as soon as they arrive
+    if (COMM_GetRxInterruptSourceMasked() & COMM_INTR_RX_NOT_EMPTY) {
+        _comm_rx_isr();
+        COMM_ClearRxInterruptSource(COMM_INTR_RX_NOT_EMPTY);
+    }
+    
+    // Top up the TX FIFO as it drains
+    if (COMM_GetTxInterruptSourceMasked() & COMM_INTR_TX_TRIGGER) {
+        _comm_tx_isr();
+        COMM_ClearTxInterruptSource(COMM_INTR_TX_TRIGGER);
+    }
+}
+#else
 CY_ISR(int_comm_isr) {
     _comm_rx_isr();
     _comm_tx_isr();
+#ifdef COMM_TICK_CALLBACK
+    comm_tick_callback();
+#endif
 }
+#endif
 
 
 /*******************************************************************************
@@ -119,14 +193,6 @@ CY_ISR(int_comm_isr) {
 *******************************************************************************/
 void comm_init()
 {    
-    // Allocate memory for the buffers
-    _rxBuffer = ringbuf_new(RX_BUFFER_SIZE);
-    _txBuffer = ringbuf_new(TX_BUFFER_SIZE);
-    
-    // Reset buffers
-    ringbuf_reset(_rxBuffer);
-    ringbuf_reset(_txBuffer);
-    
 #if USE_USBUART
     // Start USBFS component
     COMM_Start(USBFS_DEVICE, COMM_5V_OPERATION);
@@ -142,10 +208,19 @@ void comm_init()
     COMM_SpiUartClearTxBuffer();
 #endif
     
+#if COMM_EVENT_DRIVEN
+    // Setup the SCB interrupt: RX when a byte arrives, TX when the FIFO
+    // drains below COMM_TX_FIFO_LEVEL, only while there's something to send
+    COMM_SetRxInterruptMode(COMM_INTR_RX_NOT_EMPTY);
+    COMM_SetTxInterruptMode(COMM_NO_INTR_SOURCES);
+    COMM_SetTxFifoLevel(COMM_TX_FIFO_LEVEL);
+    COMM_SCB_IRQ_StartEx(int_comm_isr);
+#else
     // Setup interrupt
     CyIntSetSysVector(SYSTICK_INT_NUM, int_comm_isr);
     SysTick_Config(COMM_INT_NB_TICKS);
     NVIC_EnableIRQ(SYSTICK_INT_NUM);
+#endif
     CyGlobalIntEnable;  // In case it wasn't done if the main.
 }
 
@@ -164,20 +239,13 @@ void comm_init()
 *******************************************************************************/
 uint8 comm_getch(uint8 *data)
 {
-    uint8 count = 1;
-    
-    // Exit if 'data' is NULL or if the buffer is empty
-    if(!data || ringbuf_is_empty(_rxBuffer))
+    // Exit if 'data' is NULL
+    if(!data)
         return 0;
     
-    // Prevent interrupts
-    uint8 state = CyEnterCriticalSection();
-    
-    // Extract a single byte from the FIFO buffer
-    ringbuf_memcpy_from(data, _rxBuffer, count); 
-    
-    // Re-enable interrupts
-    CyExitCriticalSection(state);
+    // Extract a single byte from the FIFO buffer, if there's one
+    uint8 count = spsc_ring_read(&_rxBuffer, data, 1);
+    _comm_rx_resume();
     
     return count;
 }
@@ -198,29 +266,16 @@ uint8 comm_getch(uint8 *data)
 void comm_putch(uint8 *data)
 {
     uint8 count = 1;
-    uint8 state;
     
     // Exit if 'data' is NULL
     if(!data)
         return;
     
     // Wait until there's enough room in the TX buffer
-    while(1u) {
-        // Prevent interrupts
-        state = CyEnterCriticalSection();
-        
-        // Check if there's enough space free in the TX buffer
-        if(ringbuf_bytes_free(_txBuffer) >= count) break;
-        
-        // Re-enable interrupts
-        CyExitCriticalSection(state);
-    }
+    _comm_tx_reserve(count);
     
     // Copy a single byte into the FIFO buffer
-    ringbuf_memcpy_into(_txBuffer, data, count); 
-    
-    // Re-enable interrupts
-    CyExitCriticalSection(state);
+    _comm_tx_write(data, count); 
 }
 
 /*******************************************************************************
@@ -240,26 +295,21 @@ void comm_putch(uint8 *data)
 *******************************************************************************/
 uint8 comm_getline(uint8 *data)
 {
-    // Exit if 'data' is NULL or if the buffer is empty
-    if(!data || ringbuf_is_empty(_rxBuffer))
+    // Exit if 'data' is NULL
+    if(!data)
         return 0;
     
     // Look for a line terminator in the buffer, exit if not found
-    uint16 line_term_offs = ringbuf_findchr(_rxBuffer, COMM_LINE_TERMINATOR, 0);
-    if(line_term_offs == ringbuf_bytes_used(_rxBuffer))
+    uint32 line_term_offs = spsc_ring_find(&_rxBuffer, COMM_LINE_TERMINATOR, 0);
+    if(line_term_offs == SPSC_RING_NOT_FOUND)
         return 0;
     
-    // Prevent interrupts
-    uint8 state = CyEnterCriticalSection();
-    
     // Extract a line from the FIFO buffer (without the line terminator)
-    ringbuf_memcpy_from(data, _rxBuffer, line_term_offs);
+    spsc_ring_read(&_rxBuffer, data, line_term_offs);
     
     // Remove the line terminator from the FIFO buffer
-    ringbuf_remove_from_tail(_rxBuffer, 1);
-    
-    // Re-enable interrupts
-    CyExitCriticalSection(state);
+    spsc_ring_skip(&_rxBuffer, 1);
+    _comm_rx_resume();
     
     return line_term_offs;
 }
@@ -281,30 +331,41 @@ uint8 comm_getline(uint8 *data)
 *******************************************************************************/
 void comm_putline(uint8 *data, uint8 count)
 {
-    uint8 state;
-    
     // Exit if 'data' is NULL
     if(!data || count <= 0)
         return;
     
     // Wait until there's enough room in the TX buffer
-    while(1u) {
-        // Prevent interrupts
-        state = CyEnterCriticalSection();
-        
-        // Check if there's enough space free in the TX buffer
-        if(ringbuf_bytes_free(_txBuffer) >= count+1) break;
-        
-        // Re-enable interrupts
-        CyExitCriticalSection(state);
-    }
+    _comm_tx_reserve(count+1);
     
     // Copy the line into the FIFO buffer
-    ringbuf_memcpy_into(_txBuffer, data, count);
+    _comm_tx_write(data, count);
     
     // Copy the line terminator into the FIFO buffer
     uint8 line_terminator = COMM_LINE_TERMINATOR;
-    ringbuf_memcpy_into(_txBuffer, &line_terminator, 1);
+    _comm_tx_write(&line_terminator, 1);
+}
+
+/*******************************************************************************
+* Function Name: comm_get_rx_stats
+********************************************************************************
+* Summary:
+*  Get the counters of the RX path and of the message parser since
+*  comm_init().
+*   
+* Parameters:
+*  stats: Where to copy the counters.
+*
+* Return:
+*  None.
+*
+*******************************************************************************/
+void comm_get_rx_stats(comm_rx_stats_t *stats)
+{
+    // Prevent interrupts, for a consistent copy
+    uint8 state = CyEnterCriticalSection();
+    
+    *stats = _rxStats;
     
     // Re-enable interrupts
     CyExitCriticalSection(state);
@@ -315,83 +376,102 @@ void comm_putline(uint8 *data, uint8 count)
 * Function Name: comm_getmsg
 ********************************************************************************
 * Summary:
-*  Read a message from the rxBuffer. A message ends with MSG_LAST_BYTE
-*  (see comm_driver_msg.h). It may return '0' if a complete message couldn't
-*  be found in the FIFO buffer.
+*  Read a message from the rxBuffer (see comm_driver_msg.h). It returns '0'
+*  if no complete message is in the FIFO buffer yet.
+*  The parser keeps its state between calls: the header of the message at
+*  the front of the FIFO buffer is checked once, then the call only checks
+*  whether the rest arrived. Bytes that don't start a valid message are
+*  skipped, so each received byte is looked at a bounded number of times.
+*  Messages up to COMM_MSG_MAX_LENGTH bytes are accepted. Empty messages
+*  and messages larger than 'size' are removed and counted
+*  (see comm_get_rx_stats()).
 *   
 * Parameters:
 *  data: Pointer to an array of uint8 where the bytes read will be copied.
 *        The bytes used to verify the message's integrity will not be copied.
+*  size: The number of bytes 'data' can hold.
 *
 * Return:
 *  uint8: The number of bytes returned.
 *
 *******************************************************************************/
-uint8 comm_getmsg(uint8 *data)
+uint8 comm_getmsg(uint8 *data, uint8 size)
 {
-    // Exit if 'data' is NULL or if the buffer is empty
-    if(!data || ringbuf_is_empty(_rxBuffer))
+    // Exit if 'data' is NULL
+    if(!data)
         return 0;
     
-    bool message_found = false;
-    uint16 msg_first_byte_offs = 0;
-    uint8 msg_length = 0;
-    uint8 msg_last_byte = 0;
-    
-    // Find the first complete message in the FIFO buffer, exit if not found
-    while(!message_found) {
-        
-        // Find the first occurence of MSG_FIRST_BYTE, exit if not found
-        msg_first_byte_offs = ringbuf_findchr(_rxBuffer, MSG_FIRST_BYTE, 0);
-        if(msg_first_byte_offs == ringbuf_bytes_used(_rxBuffer))
-            return 0;
+    for(;;) {
         
-        // Remove all bytes until MSG_FIRST_BYTE if it's not at the begginning
-        // of the FIFO buffer
-        if(msg_first_byte_offs)
-            ringbuf_remove_from_tail(_rxBuffer, msg_first_byte_offs);
+        // Check the header of the message at the front of the FIFO buffer
+        if(_rxMsgLength == 0) {
+            uint32 used = spsc_ring_used(&_rxBuffer);
+            if(used == 0)
+                return 0;
             
-        // Extract the MSG_LENGTH, exit if not found
-        if(ringbuf_bytes_used(_rxBuffer) < MSG_HEADER_LENGTH)
-            return 0;
-        msg_length = ringbuf_peek(_rxBuffer, MSG_LENGTH_OFFS_FROM_FIRST_BYTE);
+            // Remove all bytes until MSG_FIRST_BYTE, exit if not found
+            if(spsc_ring_peek(&_rxBuffer, 0) != MSG_FIRST_BYTE) {
+                uint32 msg_first_byte_offs = spsc_ring_find(&_rxBuffer, MSG_FIRST_BYTE, 1);
+                if(msg_first_byte_offs == SPSC_RING_NOT_FOUND) {
+                    _comm_rx_discard(used);
+                    return 0;
+                }
+                _comm_rx_discard(msg_first_byte_offs);
+            }
             
-        // Check if message length is valid (smaller than buffer size)
-        if(msg_length >= 100) {
-            ringbuf_remove_from_tail(_rxBuffer, 1);
-            return 0;
+            // Extract the MSG_LENGTH, exit if not received yet
+            if(spsc_ring_used(&_rxBuffer) < MSG_HEADER_LENGTH)
+                return 0;
+            uint16 msg_length = spsc_ring_peek(&_rxBuffer, MSG_LENGTH_OFFS_FROM_FIRST_BYTE);
+            
+            // Not a message if the length is impossible: look for the next
+            // MSG_FIRST_BYTE
+            if(msg_length < MSG_STRUCTURE_LENGTH || msg_length > COMM_MSG_MAX_LENGTH) {
+                _rxStats.msgRejected++;
+                _comm_rx_discard(1);
+                continue;
+            }
+            _rxMsgLength = msg_length;
         }
         
-        // Check if MSG_LAST_BYTE is where expected, exit if not enough bytes
-        // in FIFO buffer
-        if(ringbuf_bytes_used(_rxBuffer) < msg_length)
+        // Wait for the rest of the message
+        if(spsc_ring_used(&_rxBuffer) < _rxMsgLength)
             return 0;
-        msg_last_byte = ringbuf_peek(_rxBuffer, msg_length-1);
-        if(msg_last_byte == MSG_LAST_BYTE)
-            message_found = true;
-            
-        // Remove first byte if message not found and try again
-        if(!message_found)
-            ringbuf_remove_from_tail(_rxBuffer, MSG_LENGTH_OFFS_FROM_FIRST_BYTE);
+        
+        uint8 msg_length = _rxMsgLength;
+        _rxMsgLength = 0;
+        
+        // Not a message if MSG_LAST_BYTE isn't where expected: look for the
+        // next MSG_FIRST_BYTE
+        if(spsc_ring_peek(&_rxBuffer, msg_length - 1) != MSG_LAST_BYTE) {
+            _rxStats.msgRejected++;
+            _comm_rx_discard(1);
+            continue;
+        }
+        
+        // Drop the messages the caller can't use
+        uint8 count = msg_length - MSG_STRUCTURE_LENGTH;
+        if(count == 0 || count > size) {
+            if(count)
+                _rxStats.msgTooLong++;
+            spsc_ring_skip(&_rxBuffer, msg_length);
+            _comm_rx_resume();
+            continue;
+        }
+        
+        // Remove message header from the FIFO buffer
+        spsc_ring_skip(&_rxBuffer, MSG_HEADER_LENGTH);
+        
+        // Extract the message from the FIFO buffer (without the header/footer)
+        spsc_ring_read(&_rxBuffer, data, count);
+        
+        // Remove the message footer from the FIFO buffer
+        spsc_ring_skip(&_rxBuffer, MSG_FOOTER_LENGTH);
+        _comm_rx_resume();
+        
+        _rxStats.msgReceived++;
+        return count;
     }
-    
-    // Prevent interrupts
-    uint8 state = CyEnterCriticalSection();
-    
-    // Remove message header from the FIFO buffer
-    ringbuf_remove_from_tail(_rxBuffer, MSG_HEADER_LENGTH);
-    
-    // Extract the message from the FIFO buffer (without the header/footer)
-    uint8 count = msg_length - MSG_STRUCTURE_LENGTH;
-    ringbuf_memcpy_from(data, _rxBuffer, count);
-    
-    // Remove the message footer from the FIFO buffer
-    ringbuf_remove_from_tail(_rxBuffer, MSG_FOOTER_LENGTH);
-    
-    // Re-enable interrupts
-    CyExitCriticalSection(state);
-    
-    return count;
 }
 
 /*******************************************************************************
@@ -411,39 +491,379 @@ uint8 comm_getmsg(uint8 *data)
 *******************************************************************************/
 void comm_putmsg(uint8 *data, uint8 count)
 {
-    uint8 state;
+    comm_iovec_t iov = {data, count};
+    comm_putmsgv(&iov, 1);
+}
+
+/*******************************************************************************
+* Function Name: comm_putmsgv
+********************************************************************************
+* Summary:
+*  Write a message made of several fragments to the txBuffer, without
+*  assembling it first. The fragments are copied one after the other between
+*  the header and the footer of the custom structure found in
+*  "comm_driver_msg.h".
+*   
+* Parameters:
+*  iov: The fragments of the message, in order. Empty ones are skipped.
+*  n: The number of fragments in 'iov'.
+*
+* Return:
+*  None.
+*
+*******************************************************************************/
+void comm_putmsgv(const comm_iovec_t *iov, uint8 n)
+{
+    uint16 count = _comm_msgv_length(iov, n);
+    
+    // Exit if the message is empty or too long
+    if(count == 0 || count > 0xFF - MSG_STRUCTURE_LENGTH)
+        return;
     
+    // Wait until there's enough room in the TX buffer
+    _comm_tx_reserve(count + MSG_STRUCTURE_LENGTH);
+    _comm_tx_write_msgv(iov, n, count);
+}
+
+/*******************************************************************************
+* Function Name: comm_putmsg_inplace
+********************************************************************************
+* Summary:
+*  Send a message without copying it. The header and footer of the custom
+*  structure found in "comm_driver_msg.h" are written around 'data' in the
+*  caller's buffer, and the TX interrupt sends the message from there, after
+*  everything written to the TX buffer before this call.
+*  The buffer must not be modified while comm_msg_pending() returns true.
+*   
+* Parameters:
+*  data: Pointer to the message to send. MSG_HEADER_LENGTH bytes before it
+*        and MSG_FOOTER_LENGTH bytes after its 'count' bytes must be
+*        reserved for the message structure.
+*  count: The number of bytes in the message.
+*
+* Return:
+*  None.
+*
+*******************************************************************************/
+void comm_putmsg_inplace(uint8 *data, uint8 count)
+{
     // Exit if 'data' is NULL
     if(!data || count <= 0)
         return;
     
     uint8 msg_length = count + MSG_STRUCTURE_LENGTH;
     
-    // Wait until there's enough room in the TX buffer
-    while(1u) {
-        // Prevent interrupts
-        state = CyEnterCriticalSection();
-        
-        // Check if there's enough space free in the TX buffer
-        if(ringbuf_bytes_free(_txBuffer) >= msg_length) break;
-        
-        // Re-enable interrupts
-        CyExitCriticalSection(state);
+    // Write the message structure around the message
+    uint8 *msg = data - MSG_HEADER_LENGTH;
+    msg[0] = MSG_FIRST_BYTE;
+    msg[MSG_LENGTH_OFFS_FROM_FIRST_BYTE] = msg_length;
+    data[count] = MSG_LAST_BYTE;
+    
+    // Queue the message behind what is already in the TX buffer
+    _comm_tx_queue_block(msg, msg_length, true);
+}
+
+/*******************************************************************************
+* Function Name: comm_trymsg
+********************************************************************************
+* Summary:
+*  Same as comm_putmsg(), but returns at once instead of waiting for room in
+*  the txBuffer. Nothing is written if the whole message doesn't fit.
+*   
+* Parameters:
+*  data: Pointer to an array of uint8 containing the message to send.
+*  count: The number of bytes in the array 'data'.
+*
+* Return:
+*  uint8: COMM_TX_OK if the message was written, COMM_TX_FULL if there is
+*         not enough room, COMM_TX_INVALID if 'data' is NULL or empty.
+*
+*******************************************************************************/
+uint8 comm_trymsg(uint8 *data, uint8 count)
+{
+    comm_iovec_t iov = {data, count};
+    return comm_trymsgv(&iov, 1);
+}
+
+/*******************************************************************************
+* Function Name: comm_trymsgv
+********************************************************************************
+* Summary:
+*  Same as comm_putmsgv(), but returns at once instead of waiting for room in
+*  the txBuffer. Nothing is written if the whole message doesn't fit.
+*   
+* Parameters:
+*  iov: The fragments of the message, in order. Empty ones are skipped.
+*  n: The number of fragments in 'iov'.
+*
+* Return:
+*  uint8: COMM_TX_OK if the message was written, COMM_TX_FULL if there is
+*         not enough room, COMM_TX_INVALID if the message is empty or too
+*         long.
+*
+*******************************************************************************/
+uint8 comm_trymsgv(const comm_iovec_t *iov, uint8 n)
+{
+    uint16 count = _comm_msgv_length(iov, n);
+    
+    // Exit if the message is empty or too long
+    if(count == 0 || count > 0xFF - MSG_STRUCTURE_LENGTH)
+        return COMM_TX_INVALID;
+    
+    if(spsc_ring_free(&_txBuffer) < (uint32)count + MSG_STRUCTURE_LENGTH)
+        return COMM_TX_FULL;
+    
+    _comm_tx_write_msgv(iov, n, count);
+    return COMM_TX_OK;
+}
+
+/*******************************************************************************
+* Function Name: comm_trymsg_inplace
+********************************************************************************
+* Summary:
+*  Same as comm_putmsg_inplace(), but returns at once instead of waiting for
+*  room in the in-place message queue. The message is only framed if it is
+*  queued.
+*   
+* Parameters:
+*  data: Pointer to the message to send (see comm_putmsg_inplace()).
+*  count: The number of bytes in the message.
+*
+* Return:
+*  uint8: COMM_TX_OK if the message was queued, COMM_TX_FULL if the queue is
+*         full, COMM_TX_INVALID if 'data' is NULL or empty.
+*
+*******************************************************************************/
+uint8 comm_trymsg_inplace(uint8 *data, uint8 count)
+{
+    // Exit if 'data' is NULL
+    if(!data || count <= 0)
+        return COMM_TX_INVALID;
+    
+    if((uint8)(_txBlockIn - _txBlockOut) >= TX_BLOCK_QUEUE_SIZE)
+        return COMM_TX_FULL;
+    
+    // There's room, comm_putmsg_inplace() won't wait
+    comm_putmsg_inplace(data, count);
+    return COMM_TX_OK;
+}
+
+/*******************************************************************************
+* Function Name: comm_drop_oldest_inplace
+********************************************************************************
+* Summary:
+*  Withdraw the oldest message given to comm_putmsg_inplace() or
+*  comm_trymsg_inplace() that hasn't started to be sent, so the message
+*  stream stays whole. Its buffer is released at once. Parts of long messages
+*  are never withdrawn.
+*   
+* Parameters:
+*  None.
+*
+* Return:
+*  uint8*: The pointer given for the withdrawn message, NULL if there is
+*          none to withdraw.
+*
+*******************************************************************************/
+uint8 *comm_drop_oldest_inplace()
+{
+    uint8 *dropped = NULL;
+    
+    // The comm interrupt must not start the block while it is withdrawn
+    uint8 interruptState = CyEnterCriticalSection();
+    
+    // Skip the oldest block if it is partly sent
+    uint8 i = _txBlockOut + (_txBlockSent ? 1u : 0u);
+    for(; i != _txBlockIn; i++) {
+        _txBlock_t *block = &_txBlocks[i & TX_BLOCK_QUEUE_MASK];
+        if(block->droppable && block->count) {
+            dropped = (uint8 *)block->data + MSG_HEADER_LENGTH;
+            
+            // Left in the queue without bytes, the comm interrupt skips it
+            block->data = NULL;
+            block->count = 0;
+            break;
+        }
     }
     
+    CyExitCriticalSection(interruptState);
+    return dropped;
+}
+
+/*******************************************************************************
+* Function Name: comm_msg_pending
+********************************************************************************
+* Summary:
+*  Tell if a message given to comm_putmsg_inplace() is not fully sent yet.
+*   
+* Parameters:
+*  data: Pointer given to comm_putmsg_inplace().
+*
+* Return:
+*  bool: true while the buffer is still used by the driver.
+*
+*******************************************************************************/
+bool comm_msg_pending(const uint8 *data)
+{
+    // Blocks the comm interrupt finishes meanwhile are still seen as pending
+    for(uint8 i = _txBlockOut; i != _txBlockIn; i++) {
+        if(_txBlocks[i & TX_BLOCK_QUEUE_MASK].data == data - MSG_HEADER_LENGTH)
+            return true;
+    }
+    
+    return false;
+}
+
+/*******************************************************************************
+* Function Name: comm_buffer_pending
+********************************************************************************
+* Summary:
+*  Tell if any part of a buffer is still waiting to be sent by the driver,
+*  whether it was given to comm_putmsg_inplace() or to
+*  comm_putmsg_long_part_inplace().
+*   
+* Parameters:
+*  buffer: Start of the buffer.
+*  size: The number of bytes in the buffer.
+*
+* Return:
+*  bool: true while some bytes of the buffer are still used by the driver.
+*
+*******************************************************************************/
+bool comm_buffer_pending(const uint8 *buffer, uint16 size)
+{
+    // Withdrawn blocks have no bytes, they never overlap
+    // Blocks the comm interrupt finishes meanwhile are still seen as pending
+    for(uint8 i = _txBlockOut; i != _txBlockIn; i++) {
+        const _txBlock_t *block = &_txBlocks[i & TX_BLOCK_QUEUE_MASK];
+        if(block->data < buffer + size && block->data + block->count > buffer)
+            return true;
+    }
+    
+    return false;
+}
+
+/*******************************************************************************
+* Function Name: comm_tx_idle
+********************************************************************************
+* Summary:
+*  Tell if nothing waits in the TX path of the driver: the txBuffer is empty
+*  and no in-place message is queued. COMM may still be sending the last
+*  bytes.
+*   
+* Parameters:
+*  None.
+*
+* Return:
+*  bool: true if everything given to the driver was handed to COMM.
+*
+*******************************************************************************/
+bool comm_tx_idle()
+{
+    return !spsc_ring_used(&_txBuffer) && (_txBlockIn == _txBlockOut);
+}
+
+/*******************************************************************************
+* Function Name: comm_putmsg_long_begin
+********************************************************************************
+* Summary:
+*  Start a long message (see comm_driver_msg.h). The message is then given
+*  in parts with comm_putmsg_long_part() and comm_putmsg_long_part_inplace(),
+*  and closed with comm_putmsg_long_end(). Parts are sent in the order they
+*  are given, and nothing else may be sent until the message is closed.
+*   
+* Parameters:
+*  count: The number of bytes in the message, all parts together.
+*         Must not exceed 0xFFFF - MSG_LONG_STRUCTURE_LENGTH.
+*
+* Return:
+*  None.
+*
+*******************************************************************************/
+void comm_putmsg_long_begin(uint16 count)
+{
+    uint16 msg_length = count + MSG_LONG_STRUCTURE_LENGTH;
+    uint8 msg_header[MSG_LONG_HEADER_LENGTH] =
+        {MSG_LONG_FIRST_BYTE, (uint8)(msg_length & 0xFF), (uint8)(msg_length >> 8)};
+    
+    _comm_tx_reserve(MSG_LONG_HEADER_LENGTH);
+    
     // Write the message header into the FIFO buffer
-    uint8 msg_header[MSG_HEADER_LENGTH] = {MSG_FIRST_BYTE, msg_length};
-    ringbuf_memcpy_into(_txBuffer, msg_header, MSG_HEADER_LENGTH);
+    _comm_tx_write(msg_header, MSG_LONG_HEADER_LENGTH);
+}
+
+/*******************************************************************************
+* Function Name: comm_putmsg_long_part
+********************************************************************************
+* Summary:
+*  Copy a part of a long message into the txBuffer.
+*   
+* Parameters:
+*  data: Pointer to the bytes to send.
+*  count: The number of bytes in the array 'data'. Must not exceed
+*         TX_BUFFER_SIZE (use comm_putmsg_long_part_inplace() for big parts).
+*
+* Return:
+*  None.
+*
+*******************************************************************************/
+void comm_putmsg_long_part(const uint8 *data, uint16 count)
+{
+    // Exit if 'data' is NULL
+    if(!data || count == 0 || count > TX_BUFFER_SIZE)
+        return;
     
-    // Copy the message into the FIFO buffer
-    ringbuf_memcpy_into(_txBuffer, data, count);
+    _comm_tx_reserve(count);
     
-    // Write the message footer into the FIFO buffer
+    // Copy the part into the FIFO buffer
+    _comm_tx_write(data, count);
+}
+
+/*******************************************************************************
+* Function Name: comm_putmsg_long_part_inplace
+********************************************************************************
+* Summary:
+*  Send a part of a long message without copying it. The buffer must not be
+*  modified while comm_buffer_pending() returns true for it.
+*   
+* Parameters:
+*  data: Pointer to the bytes to send.
+*  count: The number of bytes in the array 'data'.
+*
+* Return:
+*  None.
+*
+*******************************************************************************/
+void comm_putmsg_long_part_inplace(const uint8 *data, uint16 count)
+{
+    // Exit if 'data' is NULL
+    if(!data || count == 0)
+        return;
+    
+    _comm_tx_queue_block(data, count, false);
+}
+
+/*******************************************************************************
+* Function Name: comm_putmsg_long_end
+********************************************************************************
+* Summary:
+*  Close a long message started with comm_putmsg_long_begin().
+*   
+* Parameters:
+*  None.
+*
+* Return:
+*  None.
+*
+*******************************************************************************/
+void comm_putmsg_long_end()
+{
     uint8 msg_footer[MSG_FOOTER_LENGTH] = {MSG_LAST_BYTE};
-    ringbuf_memcpy_into(_txBuffer, msg_footer, MSG_FOOTER_LENGTH);
     
-    // Re-enable interrupts
-    CyExitCriticalSection(state);
+    _comm_tx_reserve(MSG_FOOTER_LENGTH);
+    
+    // Write the message footer into the FIFO buffer
+    _comm_tx_write(msg_footer, MSG_FOOTER_LENGTH);
 }
 #endif // _COMM_DRIVER_MSG_H
 
@@ -488,7 +908,7 @@ void _init_cdc(bool first_init)
 * Function Name: _comm_rx_isr
 ********************************************************************************
 * Summary:
-*  Copy all available bytes from COMM block into the RX FIFO buffer.
+*  Copy the available bytes from COMM block into the RX FIFO buffer.
 *   
 * Parameters:
 *  None.
@@ -499,8 +919,7 @@ void _init_cdc(bool first_init)
 *******************************************************************************/
 void _comm_rx_isr()
 {
-    // Prevent interrupts
-    uint8 state = CyEnterCriticalSection();
+    uint8 *span;
     
 #if USE_USBUART
     uint16 count = 0;
@@ -513,35 +932,63 @@ void _comm_rx_isr()
         
         // Check that the FIFO buffer has enough free space to receive 
         // all available bytes from COMM block
-        if (COMM_GetCount() <= ringbuf_bytes_free(_rxBuffer)) {
+        count = COMM_GetCount();
+        if (count <= spsc_ring_free(&_rxBuffer)) {
             
-            // Copy available bytes into the FIFO buffer
-            count = COMM_GetAll(_tempBuffer);
-            ringbuf_memcpy_into(_rxBuffer, _tempBuffer, count);
+            // Copy available bytes straight into the FIFO buffer, through
+            // _tempBuffer only when they wrap
+            if (count <= spsc_ring_write_span(&_rxBuffer, &span)) {
+                count = COMM_GetAll(span);
+                spsc_ring_commit(&_rxBuffer, count);
+            }
+            else {
+                count = COMM_GetAll(_tempBuffer);
+                spsc_ring_write(&_rxBuffer, _tempBuffer, count);
+            }
+            _rxStats.rxBytes += count;
+        }
+        else {
+            _rxStats.rxBufferFull++;
         }
     }
 #elif USE_UART
-    uint32 available_bytes = COMM_SpiUartGetRxBufferSize();
-    uint32 byte_read_32 = 0;
-    uint8 byte_read_8;
+    // Drain COMM in one pass, straight into contiguous spans of the FIFO
+    // buffer. Every byte is kept, zeros included. The bytes that don't fit
+    // wait in COMM.
+    uint32 available_bytes = RX_FIFO_COUNT();
+    uint32 free_bytes = spsc_ring_free(&_rxBuffer);
+    uint32 remaining = MIN(available_bytes, free_bytes);
     
-    // Check that the FIFO buffer has enough free space to receive 
-    // all available bytes from COMM
-    if (available_bytes <= ringbuf_bytes_free(_rxBuffer)) {
-        
-        // Copy available bytes into the FIFO buffer
-        for(uint32 i=0; i < available_bytes; i++) {
-            byte_read_32 = COMM_SpiUartReadRxData();
-            if(byte_read_32 == 0)
-                continue;
-            byte_read_8 = (uint8)(byte_read_32 & 0xFF);
-            ringbuf_memcpy_into(_rxBuffer, &byte_read_8, 1);
-        }
+    _rxStats.rxBytes += remaining;
+    while (remaining) {
+        uint32 count = MIN(spsc_ring_write_span(&_rxBuffer, &span), remaining);
+        for(uint32 i=0; i < count; i++)
+            span[i] = RX_FIFO_READ();
+        spsc_ring_commit(&_rxBuffer, count);
+        remaining -= count;
     }
+    
+    // The FIFO buffer is full
+    if (available_bytes > free_bytes) {
+        _rxStats.rxBufferFull++;
+        
+#if COMM_EVENT_DRIVEN
+        // Stop the RX interrupt until the main loop reads
+        // (see _comm_rx_resume())
+        COMM_SetRxInterruptMode(COMM_NO_INTR_SOURCES);
 #endif
+    }
     
-    // Re-enable interrupts
-    CyExitCriticalSection(state);
+    // Count the bytes lost by COMM and the bad frames
+    uint32 errors = COMM_GetRxInterruptSource() & COMM_INTR_RX_ERR;
+    if (errors) {
+        if (errors & COMM_INTR_RX_OVERFLOW)
+            _rxStats.rxOverflows++;
+        if (errors & (COMM_INTR_RX_FRAME_ERROR | COMM_INTR_RX_PARITY_ERROR))
+            _rxStats.rxErrors++;
+        COMM_ClearRxInterruptSource(errors);
+    }
+#endif
 }
 
 /*******************************************************************************
@@ -549,7 +996,7 @@ void _comm_rx_isr()
 ********************************************************************************
 * Summary:
 *  Try to send everything in TX FIFO buffer into the COMM block
-*  (or up to the max available bytes in the COMM block).
+*  (or up to the free space in the COMM block).
 *   
 * Parameters:
 *  None.
@@ -561,14 +1008,12 @@ void _comm_rx_isr()
 void _comm_tx_isr()
 {
     uint16 count = 0;
-    
-    // Prevent interrupts
-    uint8 state = CyEnterCriticalSection();
+    bool pending = spsc_ring_used(&_txBuffer) || (_txBlockIn != _txBlockOut);
     
 #if USE_USBUART
     // Check if there's anything in the TX FIFO buffer or if a Zero Length
     // Packet is required
-    if (!ringbuf_is_empty(_txBuffer) || _txZlpRequired) {
+    if (pending || _txZlpRequired) {
         
         // Check if USBFS configuration has changed
         _init_cdc(false);
@@ -576,13 +1021,13 @@ void _comm_tx_isr()
         // Check if USBUART is ready to send data
         if (COMM_CDCIsReady()) {
             
-            // Check the amount of bytes in the buffer
+            // Get the next bytes to send
             // Can't send more than COMM_TX_MAX_PACKET_SIZE bytes
-            count = MIN(ringbuf_bytes_used(_txBuffer), COMM_TX_MAX_PACKET_SIZE);
+            const uint8 *chunk;
+            count = _comm_tx_next_chunk(&chunk, COMM_TX_MAX_PACKET_SIZE);
             
             // Send packet
-            ringbuf_memcpy_from(_tempBuffer, _txBuffer, count);
-            COMM_PutData(_tempBuffer, count);
+            COMM_PutData(chunk, count);
             
             // Clear the buffer
             _txZlpRequired = (count == COMM_TX_MAX_PACKET_SIZE);
@@ -590,8 +1035,11 @@ void _comm_tx_isr()
         }
         
         // Discard the TX FIFO buffer content if COMM rejects too many times
+        // (a message being written by the main loop may lose its beginning)
         else if (++_txReject > TX_MAX_REJECT) {
-            ringbuf_reset(_txBuffer);
+            spsc_ring_flush(&_txBuffer);
+            _txBlockOut = _txBlockIn;
+            _txBlockSent = 0;
             _txReject = 0;
         }
         
@@ -601,31 +1049,279 @@ void _comm_tx_isr()
     }
         
 #elif USE_UART
-    // Check if there's anything in the TX FIFO buffer
-    if (!ringbuf_is_empty(_txBuffer)) {
+    // Top up COMM with the next bytes, as many as it has room for
+    uint32 uart_bytes_free = COMM_TX_MAX_PACKET_SIZE - COMM_SpiUartGetTxBufferSize();
+    while (pending && uart_bytes_free) {
         
-        uint32 uart_bytes_used = COMM_SpiUartGetTxBufferSize();
+        // Get the next bytes to send
+        const uint8 *chunk;
+        count = _comm_tx_next_chunk(&chunk, uart_bytes_free);
         
-        // Check if COMM has room in its TX buffer
-        if (uart_bytes_used == 0) {
-            
-            // Check the amount of bytes in the buffer
-            // Can't send more than COMM_TX_MAX_PACKET_SIZE bytes
-            count = MIN(ringbuf_bytes_used(_txBuffer), COMM_TX_MAX_PACKET_SIZE);
-            
-            // Send packet
-            ringbuf_memcpy_from(_tempBuffer, _txBuffer, count);
-            COMM_SpiUartPutArray(_tempBuffer, count);
-        }
+        // Send packet
+        COMM_SpiUartPutArray(chunk, count);
+        uart_bytes_free -= count;
         
-        // Expect next time
-        else {
-        }
+        pending = spsc_ring_used(&_txBuffer) || (_txBlockIn != _txBlockOut);
     }
+    
+#if COMM_EVENT_DRIVEN
+    // Nothing left to send: stop the TX interrupt until the main loop writes
+    // (see _comm_tx_write() and _comm_tx_queue_block())
+    if (!pending)
+        COMM_SetTxInterruptMode(COMM_NO_INTR_SOURCES);
+#endif
 #endif
+}
 
-    // Re-enable interrupts
-    CyExitCriticalSection(state);
+/*******************************************************************************
+* Function Name: _comm_rx_resume
+********************************************************************************
+* Summary:
+*  Restart the RX interrupt once the main loop has read bytes, in case it was
+*  stopped because the RX FIFO buffer was full. Nothing to do when the UART
+*  is polled.
+*   
+* Parameters:
+*  None.
+*
+* Return:
+*  None.
+*
+*******************************************************************************/
+void _comm_rx_resume()
+{
+#if COMM_EVENT_DRIVEN
+    COMM_SetRxInterruptMode(COMM_INTR_RX_NOT_EMPTY);
+#endif
+}
+
+#ifdef _COMM_DRIVER_MSG_H
+/*******************************************************************************
+* Function Name: _comm_rx_discard
+********************************************************************************
+* Summary:
+*  Remove bytes that don't belong to a message from the front of the RX FIFO
+*  buffer, and count them.
+*   
+* Parameters:
+*  count: The number of bytes to remove.
+*
+* Return:
+*  None.
+*
+*******************************************************************************/
+void _comm_rx_discard(uint32 count)
+{
+    spsc_ring_skip(&_rxBuffer, count);
+    _rxStats.msgSkippedBytes += count;
+    _comm_rx_resume();
+}
+#endif // _COMM_DRIVER_MSG_H
+
+/*******************************************************************************
+* Function Name: _comm_tx_write
+********************************************************************************
+* Summary:
+*  Copy bytes into the TX FIFO buffer. Their position in the TX stream is
+*  _txBuffer.head, so in-place blocks queued afterwards are sent after them.
+*  There must be enough room (see _comm_tx_reserve()).
+*   
+* Parameters:
+*  data: Pointer to the bytes to copy.
+*  count: The number of bytes to copy.
+*
+* Return:
+*  None.
+*
+*******************************************************************************/
+void _comm_tx_write(const void *data, uint16 count)
+{
+    spsc_ring_write(&_txBuffer, data, count);
+    
+#if COMM_EVENT_DRIVEN
+    // Restart the TX interrupt, after the bytes are in the FIFO buffer
+    COMM_SetTxInterruptMode(COMM_INTR_TX_TRIGGER);
+#endif
+}
+
+#ifdef _COMM_DRIVER_MSG_H
+/*******************************************************************************
+* Function Name: _comm_msgv_length
+********************************************************************************
+* Summary:
+*  Get the number of bytes of a message made of fragments.
+*   
+* Parameters:
+*  iov: The fragments of the message. NULL ones count as empty.
+*  n: The number of fragments in 'iov'.
+*
+* Return:
+*  uint16: The number of bytes in all the fragments.
+*
+*******************************************************************************/
+uint16 _comm_msgv_length(const comm_iovec_t *iov, uint8 n)
+{
+    uint16 count = 0;
+    
+    if(!iov)
+        return 0;
+    
+    for(uint8 i = 0; i < n; i++) {
+        if(iov[i].data)
+            count += iov[i].count;
+    }
+    
+    return count;
+}
+
+/*******************************************************************************
+* Function Name: _comm_tx_write_msgv
+********************************************************************************
+* Summary:
+*  Write a message made of fragments to the TX FIFO buffer, framed with the
+*  custom structure. The room must be reserved by the caller.
+*   
+* Parameters:
+*  iov: The fragments of the message.
+*  n: The number of fragments in 'iov'.
+*  count: The number of bytes in all the fragments (_comm_msgv_length()).
+*
+* Return:
+*  None.
+*
+*******************************************************************************/
+void _comm_tx_write_msgv(const comm_iovec_t *iov, uint8 n, uint16 count)
+{
+    // Write the message header into the FIFO buffer
+    uint8 msg_header[MSG_HEADER_LENGTH] = {MSG_FIRST_BYTE, (uint8)(count + MSG_STRUCTURE_LENGTH)};
+    _comm_tx_write(msg_header, MSG_HEADER_LENGTH);
+    
+    // Copy the fragments into the FIFO buffer
+    for(uint8 i = 0; i < n; i++) {
+        if(iov[i].data && iov[i].count)
+            _comm_tx_write(iov[i].data, iov[i].count);
+    }
+    
+    // Write the message footer into the FIFO buffer
+    uint8 msg_footer[MSG_FOOTER_LENGTH] = {MSG_LAST_BYTE};
+    _comm_tx_write(msg_footer, MSG_FOOTER_LENGTH);
+}
+#endif // _COMM_DRIVER_MSG_H
+
+/*******************************************************************************
+* Function Name: _comm_tx_reserve
+********************************************************************************
+* Summary:
+*  Wait until there's enough room in the TX FIFO buffer. The comm interrupt
+*  only frees more room, so it stays available to the caller.
+*   
+* Parameters:
+*  count: The number of bytes needed. Must not exceed TX_BUFFER_SIZE.
+*
+* Return:
+*  None.
+*
+*******************************************************************************/
+void _comm_tx_reserve(uint16 count)
+{
+    while(spsc_ring_free(&_txBuffer) < count);
+}
+
+/*******************************************************************************
+* Function Name: _comm_tx_queue_block
+********************************************************************************
+* Summary:
+*  Queue bytes to be sent in place, behind what is already in the TX FIFO
+*  buffer. Waits until there's room in the block queue. The block is
+*  published to the comm interrupt once it is complete.
+*   
+* Parameters:
+*  data: Pointer to the bytes to send.
+*  count: The number of bytes to send.
+*  droppable: true if the bytes are a whole message that
+*             comm_drop_oldest_inplace() may withdraw.
+*
+* Return:
+*  None.
+*
+*******************************************************************************/
+void _comm_tx_queue_block(const uint8 *data, uint16 count, bool droppable)
+{
+    // Wait until there's room in the block queue
+    while((uint8)(_txBlockIn - _txBlockOut) >= TX_BLOCK_QUEUE_SIZE);
+    
+    _txBlock_t *block = &_txBlocks[_txBlockIn & TX_BLOCK_QUEUE_MASK];
+    block->data = data;
+    block->count = count;
+    block->ringMark = _txBuffer.head;
+    block->droppable = droppable;
+    
+    // The block is filled before the comm interrupt can see it
+    __asm__ volatile ("" ::: "memory");
+    _txBlockIn++;
+    
+#if COMM_EVENT_DRIVEN
+    // Restart the TX interrupt, after the block is queued
+    COMM_SetTxInterruptMode(COMM_INTR_TX_TRIGGER);
+#endif
+}
+
+/*******************************************************************************
+* Function Name: _comm_tx_next_chunk
+********************************************************************************
+* Summary:
+*  Get the next contiguous bytes to send, keeping the order in which they
+*  were given to the driver: TX FIFO buffer bytes written before the oldest
+*  in-place block, then the block itself (without copy), then the rest.
+*  Bytes of the TX FIFO buffer are sent in place too, one contiguous span at
+*  a time. Blocks withdrawn by comm_drop_oldest_inplace() are skipped.
+*  Called from the comm interrupt only: the bytes are released before they
+*  are sent, but only the main loop writes the TX FIFO buffer and it can't
+*  run before they are copied to the COMM block.
+*   
+* Parameters:
+*  chunk: Set to the address of the bytes to send.
+*  max_count: The maximum number of bytes to return.
+*
+* Return:
+*  uint16: The number of bytes to send at 'chunk'.
+*
+*******************************************************************************/
+uint16 _comm_tx_next_chunk(const uint8 **chunk, uint16 max_count)
+{
+    uint16 count;
+    const uint8 *span;
+    uint32 ring_count = spsc_ring_read_span(&_txBuffer, &span);
+    
+    // Withdrawn blocks have no bytes: nothing in the ring waits for them
+    while (_txBlockIn != _txBlockOut &&
+           _txBlocks[_txBlockOut & TX_BLOCK_QUEUE_MASK].count == 0)
+        _txBlockOut++;
+    
+    if (_txBlockIn != _txBlockOut) {
+        _txBlock_t *block = &_txBlocks[_txBlockOut & TX_BLOCK_QUEUE_MASK];
+        
+        // Send the oldest block once the bytes written before it are gone
+        if (block->ringMark == _txBuffer.tail) {
+            count = MIN(block->count - _txBlockSent, max_count);
+            *chunk = block->data + _txBlockSent;
+            _txBlockSent += count;
+            
+            // The caller copies the chunk out before the buffer is reused
+            if (_txBlockSent == block->count) {
+                _txBlockOut++;
+                _txBlockSent = 0;
+            }
+            return count;
+        }
+        
+        ring_count = MIN(ring_count, block->ringMark - _txBuffer.tail);
+    }
+    
+    count = MIN(ring_count, max_count);
+    spsc_ring_skip(&_txBuffer, count);
+    *chunk = span;
+    return count;
 }
 
 /* [] END OF FILE */
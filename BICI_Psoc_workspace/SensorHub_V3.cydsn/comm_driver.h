@@ -35,13 +35,19 @@
 *  Handles communication through USBUART and implement circular buffers to
 *  hold more than the 64 bytes allowed by USBUART.
 * 
-* Required files (see References):
-*  ringbuf.h
-*  ringbuf.c
+* Required files:
+*  spsc_ring.h
+*  spsc_ring.c
 *
 * Required components in TopDesign:
 *  1 x USBUART or UART (named 'COMM')
 *
+* Configuration of component UART (TopDesign):
+*  Interrupt = "Internal" and RX/TX buffer sizes = FIFO depth (8) for the
+*  event-driven mode: the driver then uses the SCB interrupt (RX not empty,
+*  TX FIFO level) and leaves SysTick to the application.
+*  Otherwise the UART is polled from SysTick at COMM_INTERRUPT_FREQ.
+*
 * Configuration of component USBUART (TopDesign):
 *  Descriptor Root = "Manual (Static Allocation)"
 *
@@ -57,8 +63,8 @@
 *  Set the size of the FIFO buffers (Rx and Tx).
 *
 * System configurations (.cydwr):
-*  Heap Size (bytes) = RX_BUFFER_SIZE + TX_BUFFER_SIZE + 2 bytes
-*                      (plus 512 bytes if you use 'sprintf')
+*  The FIFO buffers are static, the driver doesn't use the heap.
+*  Heap Size (bytes) = 512 bytes if you use 'sprintf'
 *                      (plus any more heap required for your application)
 *
 * Libraries:
@@ -92,6 +98,16 @@
 * Revisions:
 *  1.0: First.
 *  1.1: Bug fix: First TX sent garbage.
+*  1.2: In-place messages, sent straight from the caller's buffer.
+*  1.3: Long messages (16-bit length) streamed in parts.
+*  1.4: Optional tick callback from the comm interrupt.
+*  1.5: Static lock-free FIFO buffers (spsc_ring), no critical sections.
+*  1.6: Event-driven UART from its SCB interrupt, when it is internal.
+*  1.7: Bulk RX from the SCB FIFO, RX counters.
+*  1.8: Non-blocking messages (comm_trymsg), withdrawal of in-place messages.
+*  1.9: Messages in fragments (comm_putmsgv), copied without assembling.
+*  1.10: Incremental message parser, lengths up to COMM_MSG_MAX_LENGTH,
+*        parser counters. comm_getmsg() takes the size of the destination.
 *
 *******************************************************************************/
 
@@ -111,18 +127,43 @@
 // You can also disable the driver by putting all following macros to '0'.
 #define USE_USBUART 0
 #define USE_UART 1
+
+// The UART is event-driven when the COMM component has an internal
+// interrupt (see the header), polled from SysTick otherwise.
+#if USE_UART && defined(COMM_SCB_IRQ_INTERNAL)
+    #if COMM_SCB_IRQ_INTERNAL
+        #define COMM_EVENT_DRIVEN (1u)
+    #endif
+#endif
+#ifndef COMM_EVENT_DRIVEN
+    #define COMM_EVENT_DRIVEN (0u)
+#endif
     
-// The desired frequency of the comm interupts.
+// The desired frequency of the comm interupts, when they are polled from
+// SysTick.
 // It will be converted to a number of ticks of the System Clock (SysClk).
 // The frequency entered here cannot be higher than that of the SysClk.
 // The number of ticks (SysClk / COMM_INTERRUPT_FREQ) must fit in a 24-bits register.
 #define COMM_INTERRUPT_FREQ (2000u)
 
-// Size of the buffers
-// Memory allocated will be larger by one byte.
-// Make sure the Heap is large enough.
-#define RX_BUFFER_SIZE (300u)  
-#define TX_BUFFER_SIZE (300u)
+// Period of the comm interrupt. If COMM_TICK_CALLBACK is defined in
+// cyapicallbacks.h, comm_tick_callback() is called at the end of each comm
+// interrupt, so the application gets a periodic tick without a timer.
+// Not when COMM_EVENT_DRIVEN: SysTick is free for the application then.
+#define COMM_TICK_US (1000000u / COMM_INTERRUPT_FREQ)
+
+// Size of the buffers, statically allocated. Must be powers of two.
+// TX_BUFFER_SIZE must hold the largest message given to comm_putmsg().
+#define RX_BUFFER_SIZE (256u)
+#define TX_BUFFER_SIZE (256u)
+
+// Longest message comm_getmsg() accepts, structure included: it must fit in
+// the RX buffer.
+#define COMM_MSG_MAX_LENGTH (MIN(0xFFu, RX_BUFFER_SIZE))
+
+// Number of in-place messages that can wait in the TX path. Must be a power
+// of two.
+#define TX_BLOCK_QUEUE_SIZE (4u)
 
 // Index of the USBUART component
 // Shouldn't be changed unless you have more than one USBFS component.
@@ -131,6 +172,33 @@
 // Terminator of a line of data (limited to a single character)
 #define COMM_LINE_TERMINATOR ((uint8)'\n')
 
+// Status returned by comm_trymsg() and comm_trymsg_inplace()
+#define COMM_TX_OK      (0u) // Message queued
+#define COMM_TX_FULL    (1u) // No room, nothing queued
+#define COMM_TX_INVALID (2u) // NULL or empty message
+
+/*******************************************************************************
+* PUBLIC TYPES
+*******************************************************************************/
+// Counters of the RX path and of the message parser (comm_get_rx_stats())
+typedef struct {
+    uint32 rxBytes;      // Bytes put into the RX FIFO buffer
+    uint32 rxBufferFull; // RX interrupts that left bytes in COMM because the
+                         // RX FIFO buffer was full
+    uint32 rxOverflows;  // Overflows of the COMM FIFO, bytes were lost
+    uint32 rxErrors;     // Frame or parity errors reported by COMM
+    uint32 msgReceived;  // Messages returned by comm_getmsg()
+    uint32 msgSkippedBytes; // Bytes skipped to find the start of a message
+    uint32 msgRejected;  // Starts of message with a bad length or footer
+    uint32 msgTooLong;   // Messages larger than the comm_getmsg() buffer
+} comm_rx_stats_t;
+
+// Fragment of a message given to comm_putmsgv() and comm_trymsgv()
+typedef struct {
+    uint8 *data;
+    uint8 count;
+} comm_iovec_t;
+
 /*******************************************************************************
 * PUBLIC PROTOTYPES
 *******************************************************************************/
@@ -145,10 +213,30 @@ void comm_putch(uint8 *data);
 uint8 comm_getline(uint8 *data);
 void comm_putline(uint8 *data, uint8 count);
 
+// Statistics
+void comm_get_rx_stats(comm_rx_stats_t *stats);
+
 // Custom messages
 #ifdef _COMM_DRIVER_MSG_H
-uint8 comm_getmsg(uint8 *data);
+uint8 comm_getmsg(uint8 *data, uint8 size);
 void comm_putmsg(uint8 *data, uint8 count);
+void comm_putmsgv(const comm_iovec_t *iov, uint8 n);
+void comm_putmsg_inplace(uint8 *data, uint8 count);
+bool comm_msg_pending(const uint8 *data);
+bool comm_buffer_pending(const uint8 *buffer, uint16 size);
+bool comm_tx_idle();
+
+// Custom messages, without waiting for room
+uint8 comm_trymsg(uint8 *data, uint8 count);
+uint8 comm_trymsgv(const comm_iovec_t *iov, uint8 n);
+uint8 comm_trymsg_inplace(uint8 *data, uint8 count);
+uint8 *comm_drop_oldest_inplace();
+
+// Long custom messages, streamed in parts
+void comm_putmsg_long_begin(uint16 count);
+void comm_putmsg_long_part(const uint8 *data, uint16 count);
+void comm_putmsg_long_part_inplace(const uint8 *data, uint16 count);
+void comm_putmsg_long_end();
 #endif // _COMM_DRIVER_MSG_H
 
 #endif // _COMM_DRIVER_H
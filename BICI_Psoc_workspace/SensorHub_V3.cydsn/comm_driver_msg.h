@@ -39,6 +39,12 @@
 *
 * The MSG_LENGTH should be used to validate the integrity of the message.
 *
+* Messages longer than 255 bytes use the long structure:
+*    MSG_LONG_FIRST_BYTE
+*    MSG_LENGTH (16 bits, little endian, from first to last byte)
+*    MSG
+*    MSG_LAST_BYTE
+*
 *******************************************************************************/
 
 #ifndef _COMM_DRIVER_MSG_H
@@ -63,6 +69,11 @@
 #define MSG_STRUCTURE_LENGTH (MSG_HEADER_LENGTH + MSG_FOOTER_LENGTH)
 #define MSG_LENGTH_OFFS_FROM_FIRST_BYTE ((unsigned char)1)
 
+// Long messages
+#define MSG_LONG_FIRST_BYTE ((unsigned char)0x02)
+#define MSG_LONG_HEADER_LENGTH ((unsigned char)3)
+#define MSG_LONG_STRUCTURE_LENGTH (MSG_LONG_HEADER_LENGTH + MSG_FOOTER_LENGTH)
+
 #endif // _COMM_DRIVER_H
 
 /* [] END OF FILE */
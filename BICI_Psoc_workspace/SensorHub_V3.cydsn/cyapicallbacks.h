@@ -16,6 +16,18 @@
     /*Define your macro callbacks here */
     /*For more information, refer to the Writing Code topic in the PSoC Creator Help.*/
 
+    /* I2CM: run the I2C scheduler at the end of each master interrupt (i2c_scheduler.c) */
+    #define I2CM_I2C_ISR_EXIT_CALLBACK
+    void I2CM_I2C_ISR_ExitCallback(void);
+    /* I2CM2 (second bus, if I2C_SCHED_BUS_COUNT > 1 in i2c_scheduler.h):
+    #define I2CM2_I2C_ISR_EXIT_CALLBACK
+    void I2CM2_I2C_ISR_ExitCallback(void); */
+
+    /* COMM: periodic tick, checks the deadline of the I2C transfers (main.c).
+    *  From SysTick instead when the comm driver is event-driven. */
+    #define COMM_TICK_CALLBACK
+    void comm_tick_callback(void);
+
     
 #endif /* CYAPICALLBACKS_H */   
 /* [] */
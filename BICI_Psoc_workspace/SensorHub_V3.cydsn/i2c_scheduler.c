@@ -0,0 +1,601 @@
+/* ========================================
+ *
+ * Copyright YOUR COMPANY, THE YEAR
+ * All Rights Reserved
+ * UNPUBLISHED, LICENSED SOFTWARE.
+ *
+ * CONFIDENTIAL AND PROPRIETARY INFORMATION
+ * WHICH IS THE PROPERTY OF your company.
+ *
+ * ========================================
+*/
+#include "i2c_scheduler.h"
+#include <string.h>
+
+/*******************************************************************************
+* MACROS
+*******************************************************************************/
+// Switch the pins of the SCB component COMP to GPIO (true) or back to the SCB
+#define _I2C_DEFINE_PINS_TO_GPIO(COMP) \
+void _##COMP##_pins_to_gpio(bool gpio) \
+{ \
+    COMP##_SET_HSIOM_SEL(COMP##_SCL_HSIOM_REG, COMP##_SCL_HSIOM_MASK, COMP##_SCL_HSIOM_POS, \
+                         gpio ? COMP##_SCL_HSIOM_SEL_GPIO : COMP##_SCL_HSIOM_SEL_I2C); \
+    COMP##_SET_HSIOM_SEL(COMP##_SDA_HSIOM_REG, COMP##_SDA_HSIOM_MASK, COMP##_SDA_HSIOM_POS, \
+                         gpio ? COMP##_SDA_HSIOM_SEL_GPIO : COMP##_SDA_HSIOM_SEL_I2C); \
+}
+
+// Set the clock and the timings of the SCB component COMP for a speed. Only
+// the clock divider and the timing/filter registers change: the component is
+// not restarted, so its interrupt state is kept and this is safe from its own
+// interrupt. The SCB must be idle (between two jobs, see _i2c_sched_start()).
+#define _I2C_DEFINE_SET_SPEED(COMP) \
+void _##COMP##_set_speed(const _I2CSpeedStruct *speed) \
+{ \
+    COMP##_SCBCLK_SetDividerValue(speed->divider); \
+    COMP##_I2C_CTRL_REG = (COMP##_I2C_CTRL_REG & \
+        ~(COMP##_I2C_CTRL_HIGH_PHASE_OVS_MASK | COMP##_I2C_CTRL_LOW_PHASE_OVS_MASK)) | \
+        ((uint32)(speed->highPhase - 1u)) | \
+        ((uint32)(speed->lowPhase - 1u) << COMP##_I2C_CTRL_LOW_PHASE_OVS_POS); \
+    if(speed->analogFilter) \
+        COMP##_I2C_CFG_REG |= COMP##_I2C_CFG_ANALOG_FITER_ENABLE; \
+    else \
+        COMP##_I2C_CFG_REG &= ~COMP##_I2C_CFG_ANALOG_FITER_ENABLE; \
+    if(speed->medianFilter) \
+        COMP##_RX_CTRL_REG |= COMP##_RX_CTRL_MEDIAN; \
+    else \
+        COMP##_RX_CTRL_REG &= ~COMP##_RX_CTRL_MEDIAN; \
+}
+
+// Speed of a bus before its first job
+#define _I2C_SPEED_UNSET (0xFFu)
+
+// API of the SCB component COMP used by the scheduler
+#define _I2C_BUS_OPS(COMP) { \
+    COMP##_I2CMasterStatus, COMP##_I2CMasterClearStatus, \
+    COMP##_I2CMasterReadBuf, COMP##_I2CMasterWriteBuf, \
+    COMP##_I2CMasterGetReadBufSize, COMP##_I2CMasterGetWriteBufSize, \
+    COMP##_Stop, COMP##_Start, \
+    COMP##_scl_Write, COMP##_sda_Write, COMP##_scl_Read, COMP##_sda_Read, \
+    _##COMP##_pins_to_gpio, _##COMP##_set_speed }
+
+
+/*******************************************************************************
+* PRIVATE TYPES
+*******************************************************************************/
+typedef struct
+{
+    uint16 divider;         // SCB clock = HFCLK / (divider + 1), register value
+    uint8 lowPhase;         // SCB clocks in the low phase of SCL
+    uint8 highPhase;        // SCB clocks in the high phase of SCL
+    bool analogFilter;      // Analog glitch filter of the inputs
+    bool medianFilter;      // Digital median filter of the inputs
+} _I2CSpeedStruct;
+
+typedef struct
+{
+    uint32 (*status)(void);
+    uint32 (*clearStatus)(void);
+    uint32 (*readBuf)(uint32 addr, uint8 *buffer, uint32 size, uint32 mode);
+    uint32 (*writeBuf)(uint32 addr, uint8 *buffer, uint32 size, uint32 mode);
+    uint32 (*readBufSize)(void);
+    uint32 (*writeBufSize)(void);
+    void (*stop)(void);
+    void (*start)(void);
+    void (*sclWrite)(uint8 value);
+    void (*sdaWrite)(uint8 value);
+    uint8 (*sclRead)(void);
+    uint8 (*sdaRead)(void);
+    void (*pinsToGpio)(bool gpio);
+    void (*setSpeed)(const _I2CSpeedStruct *speed);
+} _I2CBusOpsStruct;
+
+typedef struct
+{
+    // Job currently on the bus (NULL when the bus is idle)
+    I2CJobStruct * volatile currentJob;
+
+    // Jobs waiting for the bus
+    I2CJobStruct *jobQueue[I2C_SCHED_QUEUE_SIZE];
+    volatile uint8 jobQueueHead;
+    volatile uint8 jobQueueCount;
+
+    // Time left before the deadline of the current job (us)
+    volatile int32 jobTimeLeft;
+
+    // I2C_SPEED_xxx the SCB is set to
+    uint8 speed;
+
+    // Recovery counters
+    I2CSchedStatsStruct stats;
+} _I2CBusStruct;
+
+
+/*******************************************************************************
+* PRIVATE PROTOTYPES
+*******************************************************************************/
+bool _i2c_sched_start(uint8 bus, I2CJobStruct *job);
+void _i2c_sched_start_next(uint8 bus);
+void _i2c_sched_isr(uint8 bus);
+void _i2c_sched_abort(uint8 bus, uint32 status);
+void _i2c_sched_recover_bus(uint8 bus);
+void _I2CM_pins_to_gpio(bool gpio);
+void _I2CM_set_speed(const _I2CSpeedStruct *speed);
+#if I2C_SCHED_BUS_COUNT > 1
+void _I2CM2_pins_to_gpio(bool gpio);
+void _I2CM2_set_speed(const _I2CSpeedStruct *speed);
+#endif
+
+
+/*******************************************************************************
+* PRIVATE VARIABLES
+*******************************************************************************/
+_I2CBusStruct _buses[I2C_SCHED_BUS_COUNT];
+
+// Timings of the I2C_SPEED_xxx for a 24 MHz HFCLK, within the limits of the
+// I2C specification (tLOW >= 1.3 us and tHIGH >= 0.6 us at 400 kHz,
+// tLOW >= 0.5 us and tHIGH >= 0.26 us at 1 MHz). Fast-mode Plus uses the
+// median filter instead of the analog one, as the SCB datasheet recommends.
+// The divider is the register value: the SCB clock divides HFCLK by
+// divider + 1.
+#if CYDEV_BCLK__HFCLK__HZ != 24000000u
+    #error "The I2C speed table is computed for a 24 MHz HFCLK"
+#endif
+const _I2CSpeedStruct _speeds[I2C_SPEED_COUNT] =
+{
+    {1u, 16u, 14u, true, false},    // 24 MHz / 2 = 12 MHz, / 30 = 400 kHz
+    {0u, 13u, 11u, false, true},    // 24 MHz / 1 = 24 MHz, / 24 = 1 MHz
+};
+
+const _I2CBusOpsStruct _busOps[I2C_SCHED_BUS_COUNT] =
+{
+    _I2C_BUS_OPS(I2CM),
+#if I2C_SCHED_BUS_COUNT > 1
+    _I2C_BUS_OPS(I2CM2),
+#endif
+};
+
+
+/*******************************************************************************
+* PUBLIC FUNCTIONS
+*******************************************************************************/
+/*******************************************************************************
+* Function Name: i2c_sched_init
+********************************************************************************
+* Summary:
+*  Reset the scheduler. Must be called after the masters are started and
+*  before the first job is submitted.
+*
+* Parameters:
+*  None.
+*
+* Return:
+*  None.
+*
+*******************************************************************************/
+void i2c_sched_init()
+{
+    uint8 state = CyEnterCriticalSection();
+
+    memset(_buses, 0, sizeof(_buses));
+    for(uint8 bus = 0; bus < I2C_SCHED_BUS_COUNT; bus++)
+        _buses[bus].speed = _I2C_SPEED_UNSET;
+
+    CyExitCriticalSection(state);
+}
+
+/*******************************************************************************
+* Function Name: i2c_sched_submit
+********************************************************************************
+* Summary:
+*  Queue a transfer on its bus. It is started right away if the bus is idle,
+*  otherwise it will be started by the master interrupt once the jobs ahead of
+*  it on the same bus are done.
+*  The job and its buffer must stay valid until i2c_job_is_finished() is true.
+*
+* Parameters:
+*  job: Transfer to run. bus, i2cAddr, speed, direction, buffer and size must
+*       be set.
+*
+* Return:
+*  bool: false if the queue of the bus is full (the job was not accepted).
+*
+*******************************************************************************/
+bool i2c_sched_submit(I2CJobStruct *job)
+{
+    bool accepted = true;
+
+    if(!job || !job->buffer || job->bus >= I2C_SCHED_BUS_COUNT ||
+        job->speed >= I2C_SPEED_COUNT)
+        return false;
+
+    _I2CBusStruct *bus = &_buses[job->bus];
+
+    // Prevent interrupts
+    uint8 state = CyEnterCriticalSection();
+
+    job->xferCount = 0;
+    job->mstrStatus = 0;
+
+    if(bus->currentJob == NULL) {
+        // Bus is idle, start now (a failed start leaves the job in error)
+        _i2c_sched_start(job->bus, job);
+    }
+    else if(bus->jobQueueCount < I2C_SCHED_QUEUE_SIZE) {
+        job->state = I2C_JOB_QUEUED;
+        bus->jobQueue[(bus->jobQueueHead + bus->jobQueueCount) % I2C_SCHED_QUEUE_SIZE] = job;
+        bus->jobQueueCount++;
+    }
+    else {
+        accepted = false;
+    }
+
+    // Re-enable interrupts
+    CyExitCriticalSection(state);
+
+    return accepted;
+}
+
+/*******************************************************************************
+* Function Name: i2c_sched_is_idle
+********************************************************************************
+* Summary:
+*  Tell if all the buses are idle and no job is waiting.
+*
+* Parameters:
+*  None.
+*
+* Return:
+*  bool: true if nothing is running or queued.
+*
+*******************************************************************************/
+bool i2c_sched_is_idle()
+{
+    for(uint8 bus = 0; bus < I2C_SCHED_BUS_COUNT; bus++) {
+        if(_buses[bus].currentJob != NULL || _buses[bus].jobQueueCount != 0)
+            return false;
+    }
+    return true;
+}
+
+/*******************************************************************************
+* Function Name: i2c_sched_bus_is_busy
+********************************************************************************
+* Summary:
+*  Tell if a transfer is running on a bus.
+*
+* Parameters:
+*  bus: Index of the bus.
+*
+* Return:
+*  bool: true if a job is on the bus.
+*
+*******************************************************************************/
+bool i2c_sched_bus_is_busy(uint8 bus)
+{
+    return _buses[bus].currentJob != NULL;
+}
+
+/*******************************************************************************
+* Function Name: i2c_job_is_finished
+********************************************************************************
+* Summary:
+*  Tell if a job has ended, successfully or not.
+*
+* Parameters:
+*  job: Job previously given to i2c_sched_submit().
+*
+* Return:
+*  bool: true if the job state is I2C_JOB_DONE or I2C_JOB_ERROR.
+*
+*******************************************************************************/
+bool i2c_job_is_finished(const I2CJobStruct *job)
+{
+    return (job->state == I2C_JOB_DONE) || (job->state == I2C_JOB_ERROR);
+}
+
+/*******************************************************************************
+* Function Name: i2c_sched_tick
+********************************************************************************
+* Summary:
+*  Check the deadline of the current job of each bus. When it is missed, the
+*  job is aborted with I2C_SCHED_STATUS_TIMEOUT, the bus is recovered and the
+*  next job is started. Must be called periodically from an interrupt, so a
+*  hung bus is recovered even while the main loop waits on a job.
+*
+* Parameters:
+*  elapsedUs: Time since the previous call (us).
+*
+* Return:
+*  None.
+*
+*******************************************************************************/
+void i2c_sched_tick(uint16 elapsedUs)
+{
+    uint8 state = CyEnterCriticalSection();
+
+    for(uint8 bus = 0; bus < I2C_SCHED_BUS_COUNT; bus++) {
+        if(_buses[bus].currentJob != NULL) {
+            _buses[bus].jobTimeLeft -= elapsedUs;
+            if(_buses[bus].jobTimeLeft <= 0) {
+                _buses[bus].stats.timeouts++;
+                _i2c_sched_abort(bus, I2C_SCHED_STATUS_TIMEOUT);
+            }
+        }
+    }
+
+    CyExitCriticalSection(state);
+}
+
+/*******************************************************************************
+* Function Name: i2c_sched_get_stats
+********************************************************************************
+* Summary:
+*  Copy the recovery counters of a bus.
+*
+* Parameters:
+*  bus: Index of the bus.
+*  stats: Receives the counters.
+*
+* Return:
+*  None.
+*
+*******************************************************************************/
+void i2c_sched_get_stats(uint8 bus, I2CSchedStatsStruct *stats)
+{
+    uint8 state = CyEnterCriticalSection();
+    *stats = _buses[bus].stats;
+    CyExitCriticalSection(state);
+}
+
+
+/*******************************************************************************
+* INTERRUPTS
+*******************************************************************************/
+/*******************************************************************************
+* Function Name: I2CM_I2C_ISR_ExitCallback
+*                I2CM2_I2C_ISR_ExitCallback
+********************************************************************************
+* Summary:
+*  Called by the master components at the end of each of their interrupts.
+*
+* Parameters:
+*  None.
+*
+* Return:
+*  None.
+*
+*******************************************************************************/
+void I2CM_I2C_ISR_ExitCallback()
+{
+    _i2c_sched_isr(0u);
+}
+
+#if I2C_SCHED_BUS_COUNT > 1
+void I2CM2_I2C_ISR_ExitCallback()
+{
+    _i2c_sched_isr(1u);
+}
+#endif
+
+
+/*******************************************************************************
+* PRIVATE FUNCTIONS
+*******************************************************************************/
+_I2C_DEFINE_PINS_TO_GPIO(I2CM)
+_I2C_DEFINE_SET_SPEED(I2CM)
+#if I2C_SCHED_BUS_COUNT > 1
+_I2C_DEFINE_PINS_TO_GPIO(I2CM2)
+_I2C_DEFINE_SET_SPEED(I2CM2)
+#endif
+
+/*******************************************************************************
+* Function Name: _i2c_sched_isr
+********************************************************************************
+* Summary:
+*  When the current transfer of a bus is complete, store its result and start
+*  the next job of the bus. A bus error or a lost arbitration also recovers
+*  the bus first.
+*
+* Parameters:
+*  bus: Index of the bus whose master interrupt ran.
+*
+* Return:
+*  None.
+*
+*******************************************************************************/
+void _i2c_sched_isr(uint8 bus)
+{
+    const _I2CBusOpsStruct *ops = &_busOps[bus];
+    I2CJobStruct *job = _buses[bus].currentJob;
+
+    if(job == NULL)
+        return;
+
+    uint32 status = ops->status();
+    uint32 cmpltMask = (job->direction == I2C_JOB_READ) ?
+                        I2CM_I2C_MSTAT_RD_CMPLT : I2CM_I2C_MSTAT_WR_CMPLT;
+
+    // Transfer still in progress
+    if(0u == (status & cmpltMask))
+        return;
+
+    if(0u != (status & (I2CM_I2C_MSTAT_ERR_BUS_ERROR | I2CM_I2C_MSTAT_ERR_ARB_LOST))) {
+        _buses[bus].stats.busErrors++;
+        _i2c_sched_abort(bus, status);
+        return;
+    }
+
+    job->mstrStatus = status;
+    job->xferCount = (job->direction == I2C_JOB_READ) ?
+                        ops->readBufSize() : ops->writeBufSize();
+    job->state = (0u == (status & I2CM_I2C_MSTAT_ERR_XFER)) ?
+                    I2C_JOB_DONE : I2C_JOB_ERROR;
+
+    _i2c_sched_start_next(bus);
+}
+
+/*******************************************************************************
+* Function Name: _i2c_sched_start
+********************************************************************************
+* Summary:
+*  Start a job on a bus, switching the bus to the speed of the job first. Must
+*  be called with interrupts disabled or from the master interrupt of the bus.
+*
+* Parameters:
+*  bus: Index of the bus.
+*  job: Job to start.
+*
+* Return:
+*  bool: false if the master refused the transfer (job is then in error).
+*
+*******************************************************************************/
+bool _i2c_sched_start(uint8 bus, I2CJobStruct *job)
+{
+    const _I2CBusOpsStruct *ops = &_busOps[bus];
+    uint32 result;
+
+    if(_buses[bus].speed != job->speed) {
+        ops->setSpeed(&_speeds[job->speed]);
+        _buses[bus].speed = job->speed;
+    }
+
+    (void) ops->clearStatus();
+
+    job->state = I2C_JOB_BUSY;
+    _buses[bus].currentJob = job;
+    _buses[bus].jobTimeLeft = I2C_JOB_TIMEOUT_BASE_US + (int32)job->size * I2C_JOB_TIMEOUT_BYTE_US;
+
+    if(job->direction == I2C_JOB_READ)
+        result = ops->readBuf(job->i2cAddr, job->buffer, job->size,
+                              I2CM_I2C_MODE_COMPLETE_XFER);
+    else
+        result = ops->writeBuf(job->i2cAddr, job->buffer, job->size,
+                               I2CM_I2C_MODE_COMPLETE_XFER);
+
+    if(result != I2CM_I2C_MSTR_NO_ERROR) {
+        job->mstrStatus = result;
+        job->state = I2C_JOB_ERROR;
+        _buses[bus].currentJob = NULL;
+        return false;
+    }
+
+    return true;
+}
+
+/*******************************************************************************
+* Function Name: _i2c_sched_start_next
+********************************************************************************
+* Summary:
+*  Start the oldest queued job of a bus. Jobs that cannot be started are
+*  flagged in error and skipped. Must be called with interrupts disabled or
+*  from the master interrupt of the bus.
+*
+* Parameters:
+*  bus: Index of the bus.
+*
+* Return:
+*  None.
+*
+*******************************************************************************/
+void _i2c_sched_start_next(uint8 bus)
+{
+    _I2CBusStruct *b = &_buses[bus];
+
+    b->currentJob = NULL;
+
+    while(b->jobQueueCount > 0) {
+        I2CJobStruct *next = b->jobQueue[b->jobQueueHead];
+        b->jobQueueHead = (b->jobQueueHead + 1) % I2C_SCHED_QUEUE_SIZE;
+        b->jobQueueCount--;
+
+        if(_i2c_sched_start(bus, next))
+            break;
+    }
+}
+
+/*******************************************************************************
+* Function Name: _i2c_sched_abort
+********************************************************************************
+* Summary:
+*  End the current job of a bus in error, recover the bus and start its next
+*  job. Must be called with interrupts disabled or from the master interrupt
+*  of the bus.
+*
+* Parameters:
+*  bus: Index of the bus.
+*  status: mstrStatus stored in the job.
+*
+* Return:
+*  None.
+*
+*******************************************************************************/
+void _i2c_sched_abort(uint8 bus, uint32 status)
+{
+    I2CJobStruct *job = _buses[bus].currentJob;
+
+    job->mstrStatus = status;
+    job->xferCount = 0;
+    job->state = I2C_JOB_ERROR;
+
+    _i2c_sched_recover_bus(bus);
+    _i2c_sched_start_next(bus);
+}
+
+/*******************************************************************************
+* Function Name: _i2c_sched_recover_bus
+********************************************************************************
+* Summary:
+*  Stop the SCB, which resets its state machine and FIFOs, and drive the pins
+*  as GPIOs meanwhile. A slave stopped in the middle of a read may hold SDA
+*  low: SCL is pulsed until it releases it, then a STOP condition is sent
+*  before the SCB is started again. Takes about 100 us at most.
+*
+* Parameters:
+*  bus: Index of the bus.
+*
+* Return:
+*  None.
+*
+*******************************************************************************/
+void _i2c_sched_recover_bus(uint8 bus)
+{
+    const _I2CBusOpsStruct *ops = &_busOps[bus];
+    I2CSchedStatsStruct *stats = &_buses[bus].stats;
+
+    ops->stop();
+    stats->scbResets++;
+
+    ops->sclWrite(1u);
+    ops->sdaWrite(1u);
+    ops->pinsToGpio(true);
+    CyDelayUs(I2C_RECOVERY_HALF_PERIOD_US);
+
+    if(0u == ops->sdaRead()) {
+        stats->clockOuts++;
+        for(uint8 i = 0; i < I2C_RECOVERY_CLOCKS && 0u == ops->sdaRead(); i++) {
+            ops->sclWrite(0u);
+            CyDelayUs(I2C_RECOVERY_HALF_PERIOD_US);
+            ops->sclWrite(1u);
+            CyDelayUs(I2C_RECOVERY_HALF_PERIOD_US);
+        }
+    }
+
+    // STOP: SDA rises while SCL is high
+    ops->sclWrite(0u);
+    CyDelayUs(I2C_RECOVERY_HALF_PERIOD_US);
+    ops->sdaWrite(0u);
+    CyDelayUs(I2C_RECOVERY_HALF_PERIOD_US);
+    ops->sclWrite(1u);
+    CyDelayUs(I2C_RECOVERY_HALF_PERIOD_US);
+    ops->sdaWrite(1u);
+    CyDelayUs(I2C_RECOVERY_HALF_PERIOD_US);
+
+    if(0u == ops->sdaRead() || 0u == ops->sclRead())
+        stats->stuckBus++;
+
+    ops->pinsToGpio(false);
+    ops->start();
+}
+
+/* [] END OF FILE */
@@ -0,0 +1,130 @@
+/* ========================================
+ *
+ * Copyright YOUR COMPANY, THE YEAR
+ * All Rights Reserved
+ * UNPUBLISHED, LICENSED SOFTWARE.
+ *
+ * CONFIDENTIAL AND PROPRIETARY INFORMATION
+ * WHICH IS THE PROPERTY OF your company.
+ *
+ * ========================================
+ *
+ * Summary:
+ *  Non-blocking I2C transfer scheduler for one or more SCB I2C masters.
+ *  Jobs are queued from the main loop and completed by the I2CM interrupt:
+ *  when a transfer ends, the ISR exit callback records its result in the job
+ *  and immediately starts the next queued job, so the bus never waits on the
+ *  main loop. Each bus has its own queue, so the buses run concurrently.
+ *  Each job has its own speed: the SCB is switched to it before the job
+ *  starts, so Fast-mode and Fast-mode Plus nodes can share a bus.
+ *  Each transfer has a deadline, checked by i2c_sched_tick(). A transfer that
+ *  misses it, or that ends on a bus error, is aborted and the bus is
+ *  recovered: the SCB is reset and SCL is clocked by hand until the slave
+ *  releases SDA, then a STOP is sent. The recoveries are counted.
+ *
+ * Required components in TopDesign:
+ *  1 x SCB I2C master (named 'I2CM', bus 0)
+ *  1 x SCB I2C master (named 'I2CM2', bus 1) if I2C_SCHED_BUS_COUNT is 2
+ *
+ * Required callbacks (cyapicallbacks.h):
+ *  #define I2CM_I2C_ISR_EXIT_CALLBACK
+ *  #define I2CM2_I2C_ISR_EXIT_CALLBACK (if I2C_SCHED_BUS_COUNT is 2)
+ *
+ * Required periodic call:
+ *  i2c_sched_tick(), from an interrupt (e.g. COMM_TICK_CALLBACK of
+ *  comm_driver.h)
+ *
+ * ========================================
+*/
+
+#ifndef I2C_SCHEDULER_H
+#define I2C_SCHEDULER_H
+
+#include "project.h"
+#include <stdbool.h>
+
+/*******************************************************************************
+* MACROS
+*******************************************************************************/
+// Number of I2C masters. The CY8C4244 of SensorHub_V3 has two SCBs, one of
+// them used by COMM, so it has a single bus. A second bus, to split the
+// sensors on two buses read in parallel, needs a part with a third SCB and an
+// SCB I2C master named 'I2CM2' in TopDesign.
+#ifndef I2C_SCHED_BUS_COUNT
+#define I2C_SCHED_BUS_COUNT     (1u)
+#endif
+#if (I2C_SCHED_BUS_COUNT > 1) && !defined(CY_SCB_I2CM2_H)
+    #error "A second I2C bus needs an SCB I2C master named 'I2CM2' in TopDesign"
+#endif
+
+// Number of jobs that can wait behind the one currently on a bus
+#define I2C_SCHED_QUEUE_SIZE    (8u)
+
+// Job direction
+#define I2C_JOB_READ            (0x00u)
+#define I2C_JOB_WRITE           (0x01u)
+
+// Job speeds (see _speeds in i2c_scheduler.c)
+#define I2C_SPEED_FAST          (0x00u) // 400 kHz
+#define I2C_SPEED_FAST_PLUS     (0x01u) // 1 MHz
+#define I2C_SPEED_COUNT         (2u)
+
+// Job states
+#define I2C_JOB_IDLE            (0x00u)
+#define I2C_JOB_QUEUED          (0x01u)
+#define I2C_JOB_BUSY            (0x02u)
+#define I2C_JOB_DONE            (0x03u)
+#define I2C_JOB_ERROR           (0x04u)
+
+// Deadline of a transfer: I2C_JOB_TIMEOUT_BASE_US, plus I2C_JOB_TIMEOUT_BYTE_US
+// per byte (a byte takes 90 us at 100 kHz, the rest is left for clock
+// stretching)
+#define I2C_JOB_TIMEOUT_BASE_US (1000u)
+#define I2C_JOB_TIMEOUT_BYTE_US (100u)
+
+// Bus recovery: maximum number of SCL pulses sent to free SDA, and half
+// period of the pulses
+#define I2C_RECOVERY_CLOCKS     (9u)
+#define I2C_RECOVERY_HALF_PERIOD_US (5u)
+
+// mstrStatus of a job aborted because it missed its deadline
+#define I2C_SCHED_STATUS_TIMEOUT (0x80000000u)
+
+/*******************************************************************************
+* TYPES
+*******************************************************************************/
+typedef struct
+{
+    uint8 bus;                  // Index of the master, < I2C_SCHED_BUS_COUNT
+    uint8 i2cAddr;
+    uint8 speed;                // I2C_SPEED_xxx
+    uint8 direction;
+    uint8 *buffer;
+    uint16 size;
+    volatile uint8 state;       // I2C_JOB_xxx
+    volatile uint16 xferCount;  // Bytes actually transferred
+    volatile uint32 mstrStatus; // I2CM master status when the job ended
+} I2CJobStruct;
+
+typedef struct
+{
+    uint32 timeouts;    // Transfers aborted on their deadline
+    uint32 busErrors;   // Transfers ended by a bus error or a lost arbitration
+    uint32 scbResets;   // Bus recoveries, each one resets the SCB
+    uint32 clockOuts;   // Recoveries that had to clock SDA free
+    uint32 stuckBus;    // Recoveries after which SDA or SCL was still low
+} I2CSchedStatsStruct;
+
+/*******************************************************************************
+* PUBLIC PROTOTYPES
+*******************************************************************************/
+void i2c_sched_init();
+bool i2c_sched_submit(I2CJobStruct *job);
+bool i2c_sched_is_idle();
+bool i2c_sched_bus_is_busy(uint8 bus);
+bool i2c_job_is_finished(const I2CJobStruct *job);
+void i2c_sched_tick(uint16 elapsedUs);
+void i2c_sched_get_stats(uint8 bus, I2CSchedStatsStruct *stats);
+
+#endif // I2C_SCHEDULER_H
+/* [] END OF FILE */
@@ -9,7 +9,6 @@
  *
  * ========================================
 */
-#include "comm_driver.h"
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
@@ -17,72 +16,373 @@
 
 
 /*******************************************************************************
-* uint32 readSensor(const SensorInfoStruct* sensor)
+* void startSensorRead(ReadSlotStruct* slot, uint8 index, uint8 phase, uint8 nbPackets)
 *
-* Hub initiates the transfer to read values packet from the Slave.
+* Hub queues the transfer to read values packet from the Slave. The function
+* returns immediately, the transfer is completed by the I2CM interrupt.
 *
 * Param:
-*  - sensor: SensorInfoStruct containing the info of the sensor to read.
+*  - slot: ReadSlotStruct that will receive the packet. Must be idle.
+*  - index: index of the sensor to read in sensorList.
+*  - phase: READ_PHASE_HEADER to only read the header of the oldest scan,
+*           READ_PHASE_DATA to read whole packets.
+*  - nbPackets: number of packets read in one transfer in READ_PHASE_DATA,
+*               at most the sensor maxPackets. Ignored in READ_PHASE_HEADER.
+*******************************************************************************/
+void startSensorRead(ReadSlotStruct* slot, uint8 index, uint8 phase, uint8 nbPackets)
+{
+    SensorInfoStruct* sensor = &sensorList[index];
+    
+    slot->sensorIndex = index;
+    slot->phase = phase;
+    slot->nbPackets = nbPackets;
+    slot->job.bus = sensor->bus;
+    slot->job.i2cAddr = sensor->i2cAddr;
+    slot->job.speed = sensor->speed;
+    slot->job.direction = I2C_JOB_READ;
+    slot->job.buffer = slot->buffer + SLOT_PACKET_OFFSET;
+    if(phase == READ_PHASE_HEADER)
+    {
+        slot->job.size = NODE_HEADER_SIZE;
+    }
+    else
+    {
+        slot->job.size = nbPackets * sensor->recordSize;
+    }
+    
+    sensor->isReading = true;
+    if(!i2c_sched_submit(&slot->job))
+    {
+        //Queue full, will be retried on the next call
+        slot->job.state = I2C_JOB_IDLE;
+        sensor->isReading = false;
+    }
+}
+
+/*******************************************************************************
+* uint32 getSensorReadStatus(const ReadSlotStruct* slot)
+*
+* Check the result of a finished read.
+*
+* Param:
+*  - slot: ReadSlotStruct whose job is finished.
 *
 * Return:
 *  Status of the transfer. There are 3 statuses
-*  - TRANSFER_CMPLT: transfer completed successfully and is valid.
-*  - SLAVE_NOT_READY: transfert completed, but data is invalid.
+*  - TRANSFER_CMPLT: transfer completed successfully and holds a new scan.
+*  - SLAVE_NOT_READY: transfert completed, but no new scan is available.
 *  - TRANSFER_ERROR: the error occurred while transfer or.
 *******************************************************************************/
-uint32 readSensor(const SensorInfoStruct* sensor)
+uint32 getSensorReadStatus(const ReadSlotStruct* slot)
 {
     uint32 status = TRANSFER_ERROR;
+    const SensorInfoStruct* sensor = &sensorList[slot->sensorIndex];
+    const uint8* packet = slot->buffer + SLOT_PACKET_OFFSET;
     
-    uint32 sizeToRead = sensor->nbTaxels*2 + 8; //(4 READY_BYTE + 4 TIME_BYTE)
-    
-    (void) I2CM_I2CMasterClearStatus();
+    if (slot->job.state == I2C_JOB_DONE)
+    {
+        /* Check packet structure and that the scan is newer than the last
+        *  one sent */
+        if (slot->job.xferCount == slot->job.size &&
+            packet[0] != 0 &&
+            packet[1] == NODE_LAYOUT_VERSION &&
+            isNewSequence(sensor, readUint16(&packet[NODE_SEQUENCE_OFFSET])))
+        {
+            status = TRANSFER_CMPLT;
+        }
+        else
+        {
+            status = SLAVE_NOT_READY;
+        }
+    }
+    return (status);     
+}
+
+/*******************************************************************************
+* uint32 startCapSenseAcquisition()
+*
+* Start a CapSense scan on all sensors at the same time with an I2C general
+* call carrying NODE_CMD_START_SCAN, on each bus. A node receiving it switches
+* to triggered mode and only scans on this command, so the packets read during
+* the next pass all come from the same instant.
+*
+* The writes are queued to the I2C scheduler and the function returns right
+* away.
+*
+* Return:
+*  - TRANSFER_CMPLT: the triggers were queued.
+*  - TRANSFER_ERROR: a previous trigger is still pending or was not queued.
+*******************************************************************************/
+uint32 startCapSenseAcquisition()
+{
+    uint32 status = TRANSFER_CMPLT;
     
-    if(I2CM_I2C_MSTR_NO_ERROR ==  I2CM_I2CMasterReadBuf(sensor->i2cAddr,
-                                    sensorValueBuffer, sizeToRead,
-                                    I2CM_I2C_MODE_COMPLETE_XFER))
+    triggerCommand = NODE_CMD_START_SCAN;
+    for(uint8 bus=0; bus<I2C_SCHED_BUS_COUNT; ++bus)
     {
-        /* If I2C read started without errors, 
-        / wait until master complete read transfer */
-        while (0u == (I2CM_I2CMasterStatus() & I2CM_I2C_MSTAT_RD_CMPLT))
+        I2CJobStruct* job = &triggerJobs[bus];
+        
+        if(job->state != I2C_JOB_IDLE && !i2c_job_is_finished(job))
         {
-            /* Wait */
+            status = TRANSFER_ERROR;
+            continue;
         }
         
-        /* Display transfer status */
-        if (0u == (I2CM_I2C_MSTAT_ERR_XFER & I2CM_I2CMasterStatus()))
+        job->bus = bus;
+        job->i2cAddr = I2C_GENERAL_CALL_ADDR;
+        job->speed = I2C_SPEED_FAST;
+        job->direction = I2C_JOB_WRITE;
+        job->buffer = &triggerCommand;
+        job->size = sizeof(triggerCommand);
+        if(!i2c_sched_submit(job))
+        {
+            status = TRANSFER_ERROR;
+        }
+    }
+    return status;
+}
+
+/*******************************************************************************
+* bool runBlockingJob(I2CJobStruct* job)
+*
+* Queue a transfer and wait until it ends. Only used by the enumeration, the
+* passes never wait on the bus.
+*
+* Param:
+*  - job: I2CJobStruct to run, filled except for its state.
+*
+* Return:
+*  true if the transfer completed.
+*******************************************************************************/
+bool runBlockingJob(I2CJobStruct* job)
+{
+    if(!i2c_sched_submit(job))
+    {
+        return false;
+    }
+    while(!i2c_job_is_finished(job))
+    {
+    }
+    return job->state == I2C_JOB_DONE;
+}
+
+/*******************************************************************************
+* bool readNodeDescriptor(uint8 bus, uint8 i2cAddr, uint8* descriptor)
+*
+* Ask the node at i2cAddr on bus for its descriptor (see main.h) and read it. The
+* node handles the command in its main loop, so the read is tried again until
+* it returns the descriptor instead of the sensor packet.
+*
+* Param:
+*  - bus: I2C bus to probe.
+*  - i2cAddr: address to probe.
+*  - descriptor: receives NODE_DESCRIPTOR_SIZE bytes.
+*
+* Return:
+*  true if a node answered with a valid descriptor.
+*******************************************************************************/
+bool readNodeDescriptor(uint8 bus, uint8 i2cAddr, uint8* descriptor)
+{
+    I2CJobStruct job;
+    uint8 command = NODE_CMD_GET_DESCRIPTOR;
+    
+    job.bus = bus;
+    job.i2cAddr = i2cAddr;
+    job.speed = I2C_SPEED_FAST;
+    job.direction = I2C_JOB_WRITE;
+    job.buffer = &command;
+    job.size = sizeof(command);
+    if(!runBlockingJob(&job))
+    {
+        return false; //Nobody at this address
+    }
+    
+    for(uint8 i=0; i<DESCRIPTOR_READ_TRY; ++i)
+    {
+        CyDelay(1);
+        job.direction = I2C_JOB_READ;
+        job.buffer = descriptor;
+        job.size = NODE_DESCRIPTOR_SIZE;
+        if(runBlockingJob(&job) && job.xferCount == NODE_DESCRIPTOR_SIZE &&
+            descriptor[0] == NODE_DESCRIPTOR_MAGIC)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*******************************************************************************
+* void enumerateSensors()
+*
+* Probe the buses and build sensorList from the descriptors of the nodes
+* found, in bus then address order. A node whose register layout is not
+* supported, whose packet doesn't fit in a slot, or whose address is already
+* used on another bus, is left out. The list is then sent to the
+* host with HUB_MSG_SENSOR_LIST.
+*
+*******************************************************************************/
+void enumerateSensors()
+{
+    uint8 descriptor[NODE_DESCRIPTOR_SIZE];
+    
+    nbSensors = 0;
+    for(uint8 bus=0; bus<I2C_SCHED_BUS_COUNT; ++bus)
+    {
+        for(uint8 addr=NODE_ADDR_FIRST; addr<=NODE_ADDR_LAST && nbSensors<NUMBER_OF_SENSORS; ++addr)
         {
-            /* Check packet structure */
-            uint32 dataLen =  I2CM_I2CMasterGetReadBufSize();
-            if (dataLen == sizeToRead && sensorValueBuffer[0] == 0x01)
+            if(findSensorByAddress(addr) >= 0 || !readNodeDescriptor(bus, addr, descriptor))
             {
-                status = TRANSFER_CMPLT;
+                continue;
             }
-            else
+            
+            uint16 nbTaxels = readUint16(&descriptor[2]);
+            uint16 recordSize = readUint16(&descriptor[8]);
+            if(descriptor[1] != NODE_LAYOUT_VERSION || nbTaxels == 0 || descriptor[7] == 0 ||
+                recordSize < NODE_PREFIX_SIZE + TIME_DATA_SIZE + nbTaxels*2 ||
+                recordSize > SENSOR_BUFFER_SIZE)
             {
-                status = SLAVE_NOT_READY;
+                continue;
             }
+            
+            sensorList[nbSensors].bus = bus;
+            sensorList[nbSensors].i2cAddr = addr;
+            sensorList[nbSensors].nbTaxels = nbTaxels;
+            sensorList[nbSensors].sensorType = descriptor[4];
+            sensorList[nbSensors].firmwareVersion = descriptor[5];
+            sensorList[nbSensors].capabilities = descriptor[6];
+            sensorList[nbSensors].maxPackets = MIN(descriptor[7], SENSOR_BUFFER_SIZE / recordSize);
+            sensorList[nbSensors].recordSize = recordSize;
+            ++nbSensors;
         }
     }
-    return (status);     
+    
+    initSensorsStructs();
+    sendSensorList();
+}
+
+/*******************************************************************************
+* int findSensorByAddress(uint8 i2cAddr)
+*
+* Return:
+*  Index of the sensor at i2cAddr in sensorList, or -1 if there is none.
+*******************************************************************************/
+int findSensorByAddress(uint8 i2cAddr)
+{
+    for(uint8 i=0; i<nbSensors; ++i)
+    {
+        if(sensorList[i].i2cAddr == i2cAddr)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/*******************************************************************************
+* void sendSensorList()
+*
+* Send the sensors found by the enumeration with HUB_MSG_SENSOR_LIST.
+*******************************************************************************/
+void sendSensorList()
+{
+    uint8 msg[HUB_MSG_SENSOR_LIST_MAX_SIZE];
+    uint8* entry = &msg[SENSOR_LIST_HEADER_SIZE];
+    
+    msg[0] = HUB_MSG_TAG;
+    msg[1] = HUB_MSG_SENSOR_LIST;
+    msg[2] = nbSensors;
+    for(uint8 i=0; i<nbSensors; ++i, entry += SENSOR_LIST_ENTRY_SIZE)
+    {
+        entry[0] = sensorList[i].i2cAddr;
+        entry[1] = sensorList[i].sensorType;
+        writeUint16(&entry[2], sensorList[i].nbTaxels);
+        entry[4] = sensorList[i].firmwareVersion;
+        entry[5] = sensorList[i].bus;
+        entry[6] = sensorList[i].capabilities;
+        entry[7] = sensorList[i].speed;
+    }
+    comm_putmsg(msg, SENSOR_LIST_HEADER_SIZE + SENSOR_LIST_ENTRY_SIZE*nbSensors);
+    sensorListChanged = false;
+}
+
+/*******************************************************************************
+* void updateSensorSpeed(SensorInfoStruct* sensor, uint32 result)
+*
+* Count the failed transfers in a row of a sensor above 400 kHz, and bring it
+* back to 400 kHz after SPEED_FALLBACK_ERRORS of them. The host is told with
+* HUB_MSG_SENSOR_LIST at the end of the pass.
+*
+* Param:
+*  - sensor: SensorInfoStruct of the sensor read.
+*  - result: getSensorReadStatus() of the transfer.
+*******************************************************************************/
+void updateSensorSpeed(SensorInfoStruct* sensor, uint32 result)
+{
+    if(sensor->speed == I2C_SPEED_FAST)
+    {
+        return;
+    }
+    
+    if(result != TRANSFER_ERROR)
+    {
+        sensor->speedErrors = 0;
+    }
+    else if(++sensor->speedErrors >= SPEED_FALLBACK_ERRORS)
+    {
+        sensor->speed = I2C_SPEED_FAST;
+        sensor->speedErrors = 0;
+        sensorListChanged = true;
+    }
 }
 
 /*******************************************************************************
 * void initSensorsStructs()
 *
-* Initialize sensor list with defaults values: I2C_address, nbTaxels, isOnline
-* and wasRead.
+* Initialize the sensors found by enumerateSensors() with defaults values:
+* isOnline, wasRead, the rate and priority of their sensor type, and the
+* highest speed they support. The
+* history pool is given to the sensors in order, as long as there is room.
 *
 *******************************************************************************/
 void initSensorsStructs()
 {
+    uint16 historyUsed = 0;
+    
     //init sensorList structs
-    for(uint8 i=0; i<NUMBER_OF_SENSORS; ++i)
+    for(uint8 i=0; i<nbSensors; ++i)
     {
-        sensorList[i].i2cAddr = sensorAddrList[i];
-        sensorList[i].nbTaxels = nbTaxelList[i];
+        uint8 type = sensorList[i].sensorType < NB_SENSOR_TYPES ?
+                     sensorList[i].sensorType : SENSOR_TYPE_UNKNOWN;
+        
+        sensorList[i].history = NULL;
+        if(historyUsed + sensorList[i].nbTaxels <= HISTORY_POOL_SIZE)
+        {
+            sensorList[i].history = &historyPool[historyUsed];
+            historyUsed += sensorList[i].nbTaxels;
+        }
+        sensorList[i].historyValid = false;
+        sensorList[i].threshold = SPARSE_DEFAULT_THRESHOLD;
+        sensorList[i].rateDivisor = typeRateDivisorList[type];
+        sensorList[i].rateCounter = i % typeRateDivisorList[type]; // Spread the slow sensors
+        sensorList[i].priority = typePriorityList[type];
+        sensorList[i].isDue = false;
+        sensorList[i].frameCounter = 0;
+        sensorList[i].framesSinceKey = 0;
+
+        sensorList[i].speed = (sensorList[i].capabilities & NODE_CAP_FAST_PLUS) ?
+                              I2C_SPEED_FAST_PLUS : I2C_SPEED_FAST;
+        sensorList[i].speedErrors = 0;
         sensorList[i].isOnline = true;
+        sensorList[i].isEnabled = true;
+        sensorList[i].hasAnswered = false;
+        sensorList[i].nbFailures = 0;
+        sensorList[i].probeShift = 0;
+        sensorList[i].probeCounter = 0;
+        sensorList[i].lastSeenCycle = 0;
         sensorList[i].wasRead = false;
+        sensorList[i].isReading = false;
+        sensorList[i].lastSequence = 0;
     }
 }
 
@@ -95,105 +395,1181 @@ void initSensorsStructs()
 *******************************************************************************/
 void resetSensorsReadStatus()
 {
-    for(int i=0; i<NUMBER_OF_SENSORS; ++i)
+    for(int i=0; i<nbSensors; ++i)
     {
         sensorList[i].wasRead = false;
+        sensorList[i].isReady = false;
+        sensorList[i].hasAnswered = false;
+        sensorList[i].wasDropped = false;
         sensorList[i].nbReadTry = 0;
     }
 }
 
 /*******************************************************************************
-* uint32 sendDataToUART(const SensorInfoStruct* sensor)
+* void scheduleSensors()
+*
+* Select the sensors to read in this pass: a sensor is due once every
+* rateDivisor calls. An offline sensor is due when its next probe is.
+*
+*******************************************************************************/
+void scheduleSensors()
+{
+    for(uint8 i=0; i<nbSensors; ++i)
+    {
+        SensorInfoStruct* sensor = &sensorList[i];
+        
+        if(!sensor->isOnline)
+        {
+            sensor->isDue = (sensor->probeCounter == 0);
+            if(sensor->probeCounter > 0)
+            {
+                sensor->probeCounter--;
+            }
+            continue;
+        }
+        
+        sensor->isDue = (sensor->rateCounter == 0);
+        sensor->rateCounter = sensor->isDue ? sensor->rateDivisor - 1 : sensor->rateCounter - 1;
+    }
+}
+
+/*******************************************************************************
+* bool isSlotFree(const ReadSlotStruct* slot)
+*
+* A slot is free when no transfer uses it and its last message has left the
+* UART driver.
+*******************************************************************************/
+bool isSlotFree(const ReadSlotStruct* slot)
+{
+    return slot->job.state == I2C_JOB_IDLE &&
+           !comm_buffer_pending(slot->buffer, SLOT_BUFFER_SIZE);
+}
+
+/*******************************************************************************
+* bool isTxBackedUp()
+*
+* The UART holds the acquisition back when no slot is being read and none is
+* free: all of them wait for their message to leave the UART driver.
+*******************************************************************************/
+bool isTxBackedUp()
+{
+    for(uint8 s=0; s<NB_READ_SLOTS; ++s)
+    {
+        if(readSlots[s].job.state != I2C_JOB_IDLE || isSlotFree(&readSlots[s]))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*******************************************************************************
+* bool dropOldestMessage()
+*
+* Withdraw the oldest sensor message queued in place that the UART driver has
+* not started to send (TX_POLICY_DROP_OLDEST). Its slot is free at once and
+* the next frame of its sensor is a key frame.
+*
+* Return:
+*  true if a message was withdrawn.
+*******************************************************************************/
+bool dropOldestMessage()
+{
+    uint8* dropped = comm_drop_oldest_inplace();
+    
+    if(dropped == NULL)
+    {
+        return false;
+    }
+    
+    for(uint8 s=0; s<NB_READ_SLOTS; ++s)
+    {
+        if(dropped >= readSlots[s].buffer && dropped < readSlots[s].buffer + SLOT_BUFFER_SIZE)
+        {
+            sensorList[readSlots[s].sensorIndex].historyValid = false;
+        }
+    }
+    txDroppedOldest++;
+    return true;
+}
+
+/*******************************************************************************
+* bool sendStreamMessage(SensorInfoStruct* sensor, const comm_iovec_t* iov, uint8 n, bool inPlace)
 *
-* Send the content of sensorValueBuffer + the sensor address to the UART.
+* Give a sensor message to the UART driver, in place or copied from its
+* fragments, following txPolicy when there is no room for it:
+*  - TX_POLICY_BLOCK: wait for room.
+*  - TX_POLICY_DROP_NEWEST: drop the message.
+*  - TX_POLICY_DROP_OLDEST: withdraw the oldest messages queued in place until
+*    it fits. Withdrawing frees no room in the TX buffer, so a copied message
+*    that doesn't fit, or one that still doesn't, is dropped instead.
+* The next frame of a sensor whose message is dropped is a key frame.
 *
 * Param:
-*  - sensor: SensorInfoStruct containing the info of the sensor.
+*  - sensor: SensorInfoStruct of the sensor the message is from.
+*  - iov: the fragments of the message (see comm_putmsgv()).
+*  - n: number of fragments.
+*  - inPlace: true to send iov[0], the only fragment, in place (see
+*             comm_putmsg_inplace()).
+*
+* Return:
+*  true if the message was queued.
 *******************************************************************************/
-void sendDataToUART(const SensorInfoStruct* sensor)
+bool sendStreamMessage(SensorInfoStruct* sensor, const comm_iovec_t* iov, uint8 n, bool inPlace)
 {
-    memset(uartBuffer, 0, UART_BUFFER_SIZE);
-    //Insert the sensor id in the first byte of the message
-    uartBuffer[0] = sensor->i2cAddr;
+    uint8 status = inPlace ? comm_trymsg_inplace(iov[0].data, iov[0].count) : comm_trymsgv(iov, n);
+    
+    if(status == COMM_TX_FULL && inPlace && txPolicy == TX_POLICY_DROP_OLDEST)
+    {
+        while(status == COMM_TX_FULL && dropOldestMessage())
+        {
+            status = comm_trymsg_inplace(iov[0].data, iov[0].count);
+        }
+    }
+    
+    if(status == COMM_TX_FULL && txPolicy == TX_POLICY_BLOCK)
+    {
+        txBlockedMessages++;
+        if(inPlace)
+        {
+            comm_putmsg_inplace(iov[0].data, iov[0].count);
+        }
+        else
+        {
+            comm_putmsgv(iov, n);
+        }
+        status = COMM_TX_OK;
+    }
+    else if(status == COMM_TX_FULL)
+    {
+        txDroppedNewest++;
+        sensor->historyValid = false;
+    }
     
-    memcpy(uartBuffer + SENSOR_TAG_SIZE, sensorValueBuffer + TIME_DATA_SIZE, sensor->nbTaxels*2 + TIME_DATA_SIZE);
-    comm_putmsg((uint8*)uartBuffer, SENSOR_TAG_SIZE + TIME_DATA_SIZE + sensor->nbTaxels*2);
+    return status == COMM_TX_OK;
 }
 
 /*******************************************************************************
-* void readSensorsValues()
+* void sendDataToUART(SensorInfoStruct* sensor, uint8* packet)
 *
-* This function tries to read all sensors from the system. It iterate over all
-* sensors in the list and try to read its values. 
+* Send a sensor packet held in a slot + the sensor address to the UART.
+* The message is framed and sent in place: the slot must not be reused until
+* isSlotFree() returns true. It may be dropped (see sendStreamMessage()).
 *
-* When a sensor values is read, if it was sucessful, we send the data immediately 
-* to the UART and set this sensor to wasRead=True. If the data could not be read,
-* we increment this sensor nbReadTry++, then if nbReadTry<=10, we assume this sensor
-* is not online anymore (isOnline=false).
+* Param:
+*  - sensor: SensorInfoStruct containing the info of the sensor.
+*  - packet: a packet read from the sensor, in a slot.
+*******************************************************************************/
+void sendDataToUART(SensorInfoStruct* sensor, uint8* packet)
+{
+    comm_iovec_t msg = {packet + PACKET_MSG_OFFSET, SENSOR_TAG_SIZE + TIME_DATA_SIZE + sensor->nbTaxels*2};
+    
+    //Insert the sensor id in the byte before the time
+    msg.data[0] = sensor->i2cAddr;
+    
+    sendStreamMessage(sensor, &msg, 1, true);
+}
+
+/*******************************************************************************
+* void sendEncodedDataToUART(SensorInfoStruct* sensor, uint8* packet)
 *
-* readSensorsVAlues() exits when all sensors are either wasRead=true or isOnline=false.
-* When exiting, we reset the values of wasRead and nbReadTry of all sensors.
+* Send a sensor packet held in a slot as an encoded message (see main.h).
+* The packet is delta or sparse encoded, depending on encodingMode, against the
+* history of the sensor into a buffer, and the UART driver copies the header,
+* the time (from the slot) and the encoded taxels in turn. A key
+* frame is sent instead, in place from the slot, when the sensor has no valid
+* history, when KEY_FRAME_PERIOD frames were sent since the last one, or when
+* the encoded frame is not smaller.
 *
+* Param:
+*  - sensor: SensorInfoStruct containing the info of the sensor.
+*  - packet: a packet read from the sensor, in a slot.
 *******************************************************************************/
-void readSensorsValues()
+void sendEncodedDataToUART(SensorInfoStruct* sensor, uint8* packet)
 {
-    bool done = false;
+    const uint8* taxels = packet + NODE_PREFIX_SIZE + TIME_DATA_SIZE;
+    uint16 taxelsSize = sensor->nbTaxels*2;
+    uint8 header[ENCODED_HEADER_SIZE];
+    uint8 encoded[ENCODED_MSG_MAX_SIZE - ENCODED_HEADER_SIZE - TIME_DATA_SIZE];
+    uint16 maxSize = MIN(taxelsSize - 1, sizeof(encoded));
+    uint16 encodedSize = TAXEL_CODEC_NO_FIT;
+    uint8* msg;
     
-    //Loop until all sensors have been read or have been declared offline
-    while(!done)
+    //Encoded frame, only if it is smaller than the taxels
+    if(sensor->history != NULL && sensor->historyValid &&
+        sensor->framesSinceKey < KEY_FRAME_PERIOD - 1)
     {
-        done = true;
-        for(int index=0; index<NUMBER_OF_SENSORS; ++index)
-        { 
-            //Iterate over all sensors that are online and that were not read yet.
-            if(sensorList[index].isOnline==true && sensorList[index].wasRead==false)
+        if(encodingMode == ENCODING_MODE_SPARSE)
+        {
+            header[1] = ENCODING_SPARSE;
+            encodedSize = taxel_codec_sparse(sensor->history, taxels, sensor->nbTaxels,
+                sensor->threshold, encoded, maxSize);
+        }
+        else
+        {
+            header[1] = ENCODING_DELTA;
+            encodedSize = taxel_codec_delta(sensor->history, taxels, sensor->nbTaxels,
+                encoded, maxSize);
+            if(encodedSize != TAXEL_CODEC_NO_FIT)
             {
-                done = false;
-                memset(sensorValueBuffer, 0, SENSOR_BUFFER_SIZE);
-                
-                //Try to read sensor
-                uint32 result = readSensor(&sensorList[index]);
-                if(result == TRANSFER_CMPLT)
-                {                   
-                    sendDataToUART(&sensorList[index]);
-                    sensorList[index].wasRead = true;
-                }
-                else// if(result == SLAVE_NOT_READY)//can't read sensor, increment number of try. If over 10, remove sensor from list.
-                //Added a little patch for now (never put sensor offline)
-                {
-                    sensorList[index].nbReadTry += 1;
-                    if(sensorList[index].nbReadTry >= 5)
-                    {
-                        sensorList[index].wasRead = true;
-                    } 
-                }
-               // else
-                //{
-                //    sensorList[index].isOnline = false;
-                //}
+                taxel_codec_store(sensor->history, taxels, sensor->nbTaxels);
             }
         }
     }
     
-    resetSensorsReadStatus();
+    if(encodedSize != TAXEL_CODEC_NO_FIT)
+    {
+        msg = header;
+        sensor->framesSinceKey++;
+    }
+    else
+    {
+        //Key frame: the taxels stay where they are in the slot
+        msg = packet + PACKET_KEY_MSG_OFFSET;
+        msg[1] = ENCODING_KEY;
+        sensor->framesSinceKey = 0;
+        if(sensor->history != NULL)
+        {
+            taxel_codec_store(sensor->history, taxels, sensor->nbTaxels);
+            sensor->historyValid = true;
+        }
+    }
+    msg[0] = ENCODED_TAG_FLAG | sensor->i2cAddr;
+    msg[2] = sensor->frameCounter++;
+    
+    if(encodedSize != TAXEL_CODEC_NO_FIT)
+    {
+        comm_iovec_t iov[3] = {
+            {header, ENCODED_HEADER_SIZE},
+            {packet + NODE_PREFIX_SIZE, TIME_DATA_SIZE},
+            {encoded, (uint8)encodedSize}};
+        sendStreamMessage(sensor, iov, 3, false);
+    }
+    else
+    {
+        comm_iovec_t iov = {msg, ENCODED_HEADER_SIZE + TIME_DATA_SIZE + taxelsSize};
+        sendStreamMessage(sensor, &iov, 1, true);
+    }
 }
 
-int main(void)
+/*******************************************************************************
+* void sendSlotPackets(SensorInfoStruct* sensor, ReadSlotStruct* slot)
+*
+* Send the packets of a READ_PHASE_DATA read to the UART, oldest first, raw or
+* encoded depending on encodingMode. A packet with another layout version is
+* past the scans the node had (it answered 0xFF) and ends the read. A packet
+* whose sequence number is not past lastSequence was already sent (a release
+* the node missed) and is skipped.
+*
+* Param:
+*  - sensor: SensorInfoStruct containing the info of the sensor.
+*  - slot: ReadSlotStruct holding the packets read from the sensor.
+*******************************************************************************/
+void sendSlotPackets(SensorInfoStruct* sensor, ReadSlotStruct* slot)
 {
-    CyGlobalIntEnable;
-    comm_init();
-
-     /* Start the I2C Master */
-    I2CM_Start();
+    uint8* packet = slot->buffer + SLOT_PACKET_OFFSET;
     
-    initSensorsStructs();
-    
-    for(;;)
-    {    
-        readSensorsValues();
+    for(uint8 p=0; p<slot->nbPackets; ++p, packet += sensor->recordSize)
+    {
+        if(packet[1] != NODE_LAYOUT_VERSION)
+        {
+            break;
+        }
+        
+        uint16 sequence = readUint16(packet + NODE_SEQUENCE_OFFSET);
+        if(!isNewSequence(sensor, sequence))
+        {
+            continue;
+        }
         
-        // Delay (ms)
-        CyDelay(10u);
+        sensor->lastSequence = sequence;
+        if(encodingMode == ENCODING_MODE_RAW)
+        {
+            sendDataToUART(sensor, packet);
+        }
+        else
+        {
+            sendEncodedDataToUART(sensor, packet);
+        }
+    }
+}
+
+/*******************************************************************************
+* int findNextSensorToRead(uint8 first, uint8 bus)
+*
+* Find the next sensor, starting at index first and wrapping around, that is
+* due in this pass (online, or offline and to be probed), was not read yet and
+* has no read in flight. The sensors of the highest priority class are
+* returned first.
+*
+* Param:
+*  - first: index in sensorList where the search starts.
+*  - bus: only look at the sensors of this bus, or I2C_BUS_ANY.
+*
+* Return:
+*  Index of the sensor in sensorList, or -1 if there is none.
+*******************************************************************************/
+int findNextSensorToRead(uint8 first, uint8 bus)
+{
+    for(uint8 priority=PRIORITY_HIGH; priority<=PRIORITY_LOW; ++priority)
+    {
+        for(uint8 i=0; i<nbSensors; ++i)
+        {
+            uint8 index = (first + i) % nbSensors;
+            if(sensorList[index].isEnabled==true
+                && sensorList[index].isDue==true && sensorList[index].priority==priority
+                && (bus==I2C_BUS_ANY || sensorList[index].bus==bus)
+                && sensorList[index].wasRead==false
+                && sensorList[index].isReading==false)
+            {
+                return index;
+            }
+        }
+    }
+    return -1;
+}
+
+/*******************************************************************************
+* uint8 findIdleBus()
+*
+* Find a bus that no slot is using.
+*
+* Return:
+*  Index of the bus, or I2C_BUS_ANY if all the buses are in use.
+*******************************************************************************/
+uint8 findIdleBus()
+{
+    uint8 busUsed[I2C_SCHED_BUS_COUNT] = {0};
+    
+    for(uint8 s=0; s<NB_READ_SLOTS; ++s)
+    {
+        if(readSlots[s].job.state != I2C_JOB_IDLE)
+        {
+            busUsed[readSlots[s].job.bus] = 1;
+        }
+    }
+    for(uint8 bus=0; bus<I2C_SCHED_BUS_COUNT; ++bus)
+    {
+        if(!busUsed[bus])
+        {
+            return bus;
+        }
+    }
+    return I2C_BUS_ANY;
+}
+
+/*******************************************************************************
+* void writeUint16(uint8* dest, uint16 value)
+* void writeUint32(uint8* dest, uint32 value)
+* uint16 readUint16(const uint8* src)
+* uint32 readUint32(const uint8* src)
+*
+* Write or read a value in a message, little endian.
+*******************************************************************************/
+void writeUint16(uint8* dest, uint16 value)
+{
+    dest[0] = (uint8)(value & 0xFF);
+    dest[1] = (uint8)(value >> 8);
+}
+
+void writeUint32(uint8* dest, uint32 value)
+{
+    for(uint8 i=0; i<4; ++i)
+    {
+        dest[i] = (uint8)(value >> (8*i));
+    }
+}
+
+uint16 readUint16(const uint8* src)
+{
+    return (uint16)(src[0] | (src[1] << 8));
+}
+
+uint32 readUint32(const uint8* src)
+{
+    return (uint32)src[0] | ((uint32)src[1] << 8) |
+           ((uint32)src[2] << 16) | ((uint32)src[3] << 24);
+}
+
+/*******************************************************************************
+* bool isNewSequence(const SensorInfoStruct* sensor, uint16 sequence)
+*
+* Tell if a scan comes after the last one sent for a sensor. The sequence
+* numbers wrap around, so the scans up to 32767 sequences ahead are newer and
+* the others are older. lastSequence only moves forward this way.
+*
+* Param:
+*  - sensor: SensorInfoStruct of the sensor the scan comes from.
+*  - sequence: sequence number of the scan.
+*******************************************************************************/
+bool isNewSequence(const SensorInfoStruct* sensor, uint16 sequence)
+{
+    return (int16)(uint16)(sequence - sensor->lastSequence) > 0;
+}
+
+/*******************************************************************************
+* int nextReadySensor(int first)
+*
+* Find the first sensor, starting at index first, whose header showed a new
+* scan during this pass.
+*
+* Return:
+*  Index of the sensor in sensorList, or nbSensors if there is none.
+*******************************************************************************/
+int nextReadySensor(int first)
+{
+    while(first < nbSensors && !sensorList[first].isReady)
+    {
+        ++first;
+    }
+    return first;
+}
+
+/*******************************************************************************
+* void readSensors(uint8 lastPhase)
+*
+* This function tries to read all sensors from the system. Reads are queued to
+* the I2C scheduler in NB_READ_SLOTS slots: while a slot is being filled on
+* the bus, the packet of the previous slot is sent to the UART from the slot.
+*
+* Each sensor is first polled with a NODE_HEADER_SIZE read. The packets are
+* read in the same slot only if the header shows a new scan, so a sensor
+* that is not ready costs a couple of bytes on the bus instead of a full packet.
+* All the scans waiting in the FIFO of the node are read in a single transfer,
+* as many as the slot holds (maxPackets), and sent one message each.
+*
+* When a sensor values is read, if it was sucessful, we send the data immediately 
+* to the UART and set this sensor to wasRead=True. If the data could not be read,
+* we increment this sensor nbReadTry++ and the sensor is queued again later,
+* until nbReadTry reaches MAX_READ_TRY. An offline sensor is only probed once.
+* hasAnswered is set for the sensors that acknowledged a read, whether they
+* had a new scan or not (see updateSensorsHealth()).
+*
+* A slot is reused once its message has left the UART driver. When the UART
+* holds all the slots back (isTxBackedUp()), txPolicy decides: wait, leave the
+* new scan on the node (wasDropped, counted in txDroppedNewest), or withdraw
+* the oldest queued messages.
+*
+* readSensors() exits when all the sensors due in this pass have wasRead=true
+* or isEnabled=false.
+*
+* Param:
+*  - lastPhase: READ_PHASE_DATA to read and send the packets, READ_PHASE_HEADER
+*               to only poll the headers and flag the sensors that are ready.
+*******************************************************************************/
+void readSensors(uint8 lastPhase)
+{
+    bool done = false;
+    bool blocked = false;
+    uint8 nextSensor = 0;
+    
+    //Loop until all sensors have been read or have been declared offline
+    while(!done)
+    {
+        done = true;
+        for(uint8 s=0; s<NB_READ_SLOTS; ++s)
+        {
+            ReadSlotStruct* slot = &readSlots[s];
+            
+            //Ship the packet of a finished transfer and free its slot
+            if(i2c_job_is_finished(&slot->job))
+            {
+                SensorInfoStruct* sensor = &sensorList[slot->sensorIndex];
+                uint32 result = getSensorReadStatus(slot);
+                slot->job.state = I2C_JOB_IDLE;
+                sensor->hasAnswered |= (result != TRANSFER_ERROR);
+                updateSensorSpeed(sensor, result);
+                
+                if(result == TRANSFER_CMPLT && slot->phase < lastPhase)
+                {
+                    //New scans available, read as many as the slot holds in
+                    //one transfer, in the same slot
+                    startSensorRead(slot, slot->sensorIndex, READ_PHASE_DATA,
+                        MIN(slot->buffer[SLOT_PACKET_OFFSET], sensor->maxPackets));
+                }
+                else
+                {
+                    if(result == TRANSFER_CMPLT)
+                    {
+                        if(slot->phase == READ_PHASE_DATA)
+                        {
+                            sendSlotPackets(sensor, slot);
+                        }
+                        sensor->isReady = true;
+                        sensor->wasRead = true;
+                    }
+                    else//can't read sensor, increment number of try
+                    {
+                        sensor->nbReadTry += 1;
+                        if(sensor->nbReadTry >= (sensor->isOnline ? MAX_READ_TRY : 1u))
+                        {
+                            sensor->wasRead = true;
+                        } 
+                    }
+                    sensor->isReading = false;
+                }
+            }
+            
+            //Queue the next sensor that still has to be read, preferably on
+            //a bus that is not in use so the buses are read in parallel
+            if(slot->job.state == I2C_JOB_IDLE)
+            {
+                int index = findNextSensorToRead(nextSensor, findIdleBus());
+                if(index < 0)
+                {
+                    index = findNextSensorToRead(nextSensor, I2C_BUS_ANY);
+                }
+                if(index >= 0 && !isSlotFree(slot) && isTxBackedUp())
+                {
+                    if(txPolicy == TX_POLICY_DROP_OLDEST)
+                    {
+                        //Free a slot, the sensor is read in the first one
+                        while(isTxBackedUp() && dropOldestMessage());
+                    }
+                    else if(txPolicy == TX_POLICY_DROP_NEWEST)
+                    {
+                        //The scan stays on the node
+                        sensorList[index].wasRead = true;
+                        sensorList[index].wasDropped = true;
+                        txDroppedNewest++;
+                        index = -1;
+                    }
+                    else if(!blocked)
+                    {
+                        blocked = true;
+                        txBlockedMessages++;
+                    }
+                }
+                if(index >= 0 && isSlotFree(slot))
+                {
+                    startSensorRead(slot, index, READ_PHASE_HEADER, 0);
+                    nextSensor = (index + 1) % nbSensors;
+                    blocked = false;
+                }
+                
+                //Still to be read: a slot will free up
+                if(index >= 0)
+                {
+                    done = false;
+                }
+            }
+            
+            if(slot->job.state != I2C_JOB_IDLE)
+            {
+                done = false;
+            }
+        }
+    }
+}
+
+/*******************************************************************************
+* void sendHandFrame()
+*
+* Send one hand frame (see main.h) with the sensors flagged isReady by
+* readSensors(READ_PHASE_HEADER). The frame is too big for the RAM, so it is
+* streamed as a long message: its length is known from the ready sensors, then
+* the packets are read in sensorList order, using the slots in turn, and each
+* one is sent in place from its slot. A packet that still can't be read after
+* MAX_READ_TRY tries is sent as zeros and flagged in the failed bitmap.
+*
+* A long message can't be dropped once started: with a drop policy (txPolicy)
+* the whole frame is dropped, leaving the scans on the nodes, if the UART
+* driver still holds messages when it starts. frameSequence still counts it.
+*
+*******************************************************************************/
+void sendHandFrame()
+{
+    uint8 header[HAND_FRAME_HEADER_SIZE];
+    uint8 footer[HAND_FRAME_FOOTER_SIZE];
+    uint32 present = 0;
+    uint32 failed = 0;
+    uint16 length = HAND_FRAME_HEADER_SIZE + HAND_FRAME_FOOTER_SIZE;
+    
+    if(!comm_tx_idle())
+    {
+        if(txPolicy != TX_POLICY_BLOCK)
+        {
+            txDroppedNewest++;
+            ++frameSequence;
+            return;
+        }
+        txBlockedMessages++;
+    }
+    
+    for(uint8 i=0; i<nbSensors; ++i)
+    {
+        if(sensorList[i].isReady)
+        {
+            present |= (1ul << i);
+            length += TIME_DATA_SIZE + sensorList[i].nbTaxels*2;
+            sensorList[i].nbReadTry = 0;
+        }
+    }
+    
+    header[0] = HUB_MSG_TAG;
+    header[1] = HUB_MSG_HAND_FRAME;
+    writeUint16(&header[2], frameSequence);
+    writeUint32(&header[4], present);
+    comm_putmsg_long_begin(length);
+    comm_putmsg_long_part(header, HAND_FRAME_HEADER_SIZE);
+    
+    //Packets are read in order in the slots in turn, and sent in the same order
+    int readIndex = nextReadySensor(0);
+    int sendIndex = readIndex;
+    uint8 readSlot = 0;
+    uint8 sendSlot = 0;
+    
+    while(sendIndex < nbSensors)
+    {
+        ReadSlotStruct* slot = &readSlots[readSlot];
+        
+        //Queue the next packet in the next slot in turn
+        if(readIndex < nbSensors && isSlotFree(slot))
+        {
+            startSensorRead(slot, readIndex, READ_PHASE_DATA, 1);
+            if(slot->job.state != I2C_JOB_IDLE)
+            {
+                readIndex = nextReadySensor(readIndex + 1);
+                readSlot = (readSlot + 1) % NB_READ_SLOTS;
+            }
+        }
+        
+        //Send the oldest packet once read
+        slot = &readSlots[sendSlot];
+        if(i2c_job_is_finished(&slot->job))
+        {
+            SensorInfoStruct* sensor = &sensorList[slot->sensorIndex];
+            uint32 result = getSensorReadStatus(slot);
+            slot->job.state = I2C_JOB_IDLE;
+            updateSensorSpeed(sensor, result);
+            
+            if(result != TRANSFER_CMPLT && ++sensor->nbReadTry < MAX_READ_TRY)
+            {
+                //Read it again in the same slot
+                startSensorRead(slot, slot->sensorIndex, READ_PHASE_DATA, 1);
+                if(slot->job.state != I2C_JOB_IDLE)
+                {
+                    continue;
+                }
+            }
+            
+            uint8* entry = slot->buffer + SLOT_PACKET_OFFSET + NODE_PREFIX_SIZE;
+            uint16 entrySize = TIME_DATA_SIZE + sensor->nbTaxels*2;
+            if(result == TRANSFER_CMPLT)
+            {
+                sensor->lastSequence = readUint16(slot->buffer + SLOT_PACKET_OFFSET + NODE_SEQUENCE_OFFSET);
+            }
+            else
+            {
+                memset(entry, 0, entrySize);
+                failed |= (1ul << slot->sensorIndex);
+            }
+            comm_putmsg_long_part_inplace(entry, entrySize);
+            
+            sensor->isReading = false;
+            sendIndex = nextReadySensor(sendIndex + 1);
+            sendSlot = (sendSlot + 1) % NB_READ_SLOTS;
+        }
+    }
+    
+    writeUint32(footer, failed);
+    comm_putmsg_long_part(footer, HAND_FRAME_FOOTER_SIZE);
+    comm_putmsg_long_end();
+    
+    ++frameSequence;
+}
+
+/*******************************************************************************
+* void updateSensorsHealth()
+*
+* Update the health of the sensors read in this pass (see main.h), from
+* hasAnswered. A sensor that answered is seen in this cycle, even if it had
+* no new scan. HUB_MSG_HEALTH is sent when a sensor goes offline or back online.
+*
+*******************************************************************************/
+void updateSensorsHealth()
+{
+    bool changed = false;
+    
+    for(uint8 i=0; i<nbSensors; ++i)
+    {
+        SensorInfoStruct* sensor = &sensorList[i];
+        
+        if(!sensor->isDue || !sensor->isEnabled || sensor->wasDropped)
+        {
+            continue;
+        }
+        
+        if(sensor->hasAnswered)
+        {
+            changed |= !sensor->isOnline;
+            sensor->isOnline = true;
+            sensor->nbFailures = 0;
+            sensor->probeShift = 0;
+            sensor->lastSeenCycle = lastCycleCount;
+            continue;
+        }
+        
+        if(sensor->nbFailures < 0xFF)
+        {
+            sensor->nbFailures++;
+        }
+        if(sensor->isOnline)
+        {
+            if(sensor->nbFailures >= SENSOR_OFFLINE_FAILURES)
+            {
+                //First probe on the next cycle
+                sensor->isOnline = false;
+                sensor->probeShift = 0;
+                sensor->probeCounter = 0;
+                sensor->historyValid = false;
+                changed = true;
+            }
+        }
+        else
+        {
+            //Failed probe, wait twice as long for the next one
+            if(sensor->probeShift < MAX_PROBE_SHIFT)
+            {
+                sensor->probeShift++;
+            }
+            sensor->probeCounter = (1u << sensor->probeShift) - 1;
+        }
+    }
+    
+    if(changed)
+    {
+        sendSensorsHealth();
+    }
+}
+
+/*******************************************************************************
+* void sendSensorsHealth()
+*
+* Send the health of all the sensors with HUB_MSG_HEALTH.
+*******************************************************************************/
+void sendSensorsHealth()
+{
+    uint8 msg[HUB_MSG_HEALTH_MAX_SIZE];
+    uint8* entry = &msg[HEALTH_HEADER_SIZE];
+    
+    msg[0] = HUB_MSG_TAG;
+    msg[1] = HUB_MSG_HEALTH;
+    writeUint32(&msg[2], lastCycleCount);
+    for(uint8 i=0; i<nbSensors; ++i, entry += HEALTH_ENTRY_SIZE)
+    {
+        entry[0] = sensorList[i].isOnline;
+        entry[1] = sensorList[i].nbFailures;
+        writeUint16(&entry[2], (uint16)MIN(lastCycleCount - sensorList[i].lastSeenCycle, 0xFFFFu));
+    }
+    comm_putmsg(msg, HEALTH_HEADER_SIZE + HEALTH_ENTRY_SIZE*nbSensors);
+}
+
+/*******************************************************************************
+* void readSensorsValues()
+*
+* Read one pass of all the sensors and send it to the UART, either one message
+* per sensor or one hand frame, depending on streamMode. Only the sensors due in
+* this cycle (see scheduleSensors()) are read. The scans read are the
+* ones published by the trigger sent at the start of the cycle.
+*
+* When exiting, the health of the sensors read is updated, we reset the
+* values of wasRead and nbReadTry of all sensors, and the host is sent the
+* sensor list if a sensor changed speed.
+*
+*******************************************************************************/
+void readSensorsValues()
+{
+    scheduleSensors();
+    
+    if(streamMode == STREAM_HAND_FRAME)
+    {
+        readSensors(READ_PHASE_HEADER);
+        sendHandFrame();
+    }
+    else
+    {
+        readSensors(READ_PHASE_DATA);
+    }
+    
+    updateSensorsHealth();
+    resetSensorsReadStatus();
+    
+    if(sensorListChanged)
+    {
+        sendSensorList();
+    }
+}
+
+/*******************************************************************************
+* void sendHostAck(uint8 command, uint8 result)
+*
+* Answer a host command with HUB_MSG_ACK.
+*
+* Param:
+*  - command: the HOST_CMD_xxx received.
+*  - result: HOST_ACK_xxx.
+*******************************************************************************/
+void sendHostAck(uint8 command, uint8 result)
+{
+    uint8 msg[4] = {HUB_MSG_TAG, HUB_MSG_ACK, command, result};
+    comm_putmsg(msg, sizeof(msg));
+}
+
+/*******************************************************************************
+* void sendHubStatus()
+*
+* Send the streaming settings and the state of the sensors with HUB_MSG_STATUS.
+*******************************************************************************/
+void sendHubStatus()
+{
+    uint8 msg[HUB_MSG_STATUS_SIZE];
+    uint32 enabled = 0;
+    uint32 online = 0;
+    
+    for(uint8 i=0; i<nbSensors; ++i)
+    {
+        enabled |= sensorList[i].isEnabled ? (1ul << i) : 0;
+        online |= sensorList[i].isOnline ? (1ul << i) : 0;
+    }
+    
+    msg[0] = HUB_MSG_TAG;
+    msg[1] = HUB_MSG_STATUS;
+    msg[2] = streaming;
+    msg[3] = streamMode;
+    msg[4] = encodingMode;
+    writeUint16(&msg[5], cyclePeriod);
+    writeUint32(&msg[7], enabled);
+    writeUint32(&msg[11], online);
+    writeUint16(&msg[15], frameSequence);
+    writeUint32(&msg[17], overrunCount);
+    comm_putmsg(msg, sizeof(msg));
+}
+
+/*******************************************************************************
+* void sendBusStats(uint8 bus)
+*
+* Send the I2C recovery counters of a bus with HUB_MSG_BUS_STATS.
+*******************************************************************************/
+void sendBusStats(uint8 bus)
+{
+    uint8 msg[HUB_MSG_BUS_STATS_SIZE];
+    I2CSchedStatsStruct stats;
+    
+    i2c_sched_get_stats(bus, &stats);
+    reportedBusResets[bus] = stats.scbResets;
+    
+    msg[0] = HUB_MSG_TAG;
+    msg[1] = HUB_MSG_BUS_STATS;
+    msg[2] = bus;
+    writeUint32(&msg[3], stats.timeouts);
+    writeUint32(&msg[7], stats.busErrors);
+    writeUint32(&msg[11], stats.scbResets);
+    writeUint32(&msg[15], stats.clockOuts);
+    writeUint32(&msg[19], stats.stuckBus);
+    comm_putmsg(msg, sizeof(msg));
+}
+
+/*******************************************************************************
+* void sendLinkStats()
+*
+* Send the counters of the host link with HUB_MSG_LINK_STATS.
+*******************************************************************************/
+void sendLinkStats()
+{
+    uint8 msg[HUB_MSG_LINK_STATS_SIZE];
+    comm_rx_stats_t stats;
+    
+    comm_get_rx_stats(&stats);
+    reportedLinkLosses = stats.rxOverflows + stats.rxErrors + stats.msgRejected +
+                         stats.msgTooLong + txDroppedNewest + txDroppedOldest;
+    
+    msg[0] = HUB_MSG_TAG;
+    msg[1] = HUB_MSG_LINK_STATS;
+    writeUint32(&msg[2], stats.rxBytes);
+    writeUint32(&msg[6], stats.rxBufferFull);
+    writeUint32(&msg[10], stats.rxOverflows);
+    writeUint32(&msg[14], stats.rxErrors);
+    writeUint32(&msg[18], txBlockedMessages);
+    writeUint32(&msg[22], txDroppedNewest);
+    writeUint32(&msg[26], txDroppedOldest);
+    writeUint32(&msg[30], stats.msgReceived);
+    writeUint32(&msg[34], stats.msgSkippedBytes);
+    writeUint32(&msg[38], stats.msgRejected);
+    writeUint32(&msg[42], stats.msgTooLong);
+    comm_putmsg(msg, sizeof(msg));
+}
+
+/*******************************************************************************
+* void processHostCommands()
+*
+* Handle all the commands received from the host (see main.h). It is only
+* called between two passes of readSensorsValues(), so a command never delays
+* a transfer or changes the settings in the middle of a pass.
+*
+*******************************************************************************/
+void processHostCommands()
+{
+    uint8 cmd[HOST_CMD_MAX_SIZE];
+    uint8 size;
+    
+    while((size = comm_getmsg(cmd, sizeof(cmd))) > 0)
+    {
+        uint8 result = HOST_ACK_OK;
+        
+        switch(cmd[0])
+        {
+            case HOST_CMD_START:
+                streaming = true;
+            break;
+            case HOST_CMD_STOP:
+                streaming = false;
+            break;
+            case HOST_CMD_SET_SENSOR_MASK:
+                if(size < 5)
+                {
+                    result = HOST_ACK_BAD_ARGUMENT;
+                    break;
+                }
+                for(uint8 i=0; i<nbSensors; ++i)
+                {
+                    sensorList[i].isEnabled = (readUint32(&cmd[1]) & (1ul << i)) != 0;
+                }
+            break;
+            case HOST_CMD_SET_PERIOD:
+                if(size < 3 || readUint16(&cmd[1]) == 0 ||
+                    readUint16(&cmd[1]) > MAX_CYCLE_PERIOD)
+                {
+                    result = HOST_ACK_BAD_ARGUMENT;
+                    break;
+                }
+                setCyclePeriod(readUint16(&cmd[1]));
+            break;
+            case HOST_CMD_SET_ENCODING:
+                if(size < 2 || cmd[1] > ENCODING_MODE_SPARSE)
+                {
+                    result = HOST_ACK_BAD_ARGUMENT;
+                    break;
+                }
+                if(cmd[1] != encodingMode)
+                {
+                    //Start the new encoding with key frames
+                    for(uint8 i=0; i<nbSensors; ++i)
+                    {
+                        sensorList[i].historyValid = false;
+                    }
+                    encodingMode = cmd[1];
+                }
+            break;
+            case HOST_CMD_GET_STATUS:
+                sendHubStatus();
+            continue;
+            case HOST_CMD_GET_HEALTH:
+                sendSensorsHealth();
+            continue;
+            case HOST_CMD_GET_SENSORS:
+                sendSensorList();
+            continue;
+            case HOST_CMD_ENUMERATE:
+                enumerateSensors();
+            break;
+            case HOST_CMD_GET_LINK_STATS:
+                sendLinkStats();
+            continue;
+            case HOST_CMD_GET_BUS_STATS:
+                for(uint8 bus=0; bus<I2C_SCHED_BUS_COUNT; ++bus)
+                {
+                    sendBusStats(bus);
+                }
+            continue;
+            case HOST_CMD_SET_STREAM_MODE:
+                if(size < 2 || cmd[1] > STREAM_HAND_FRAME)
+                {
+                    result = HOST_ACK_BAD_ARGUMENT;
+                    break;
+                }
+                streamMode = cmd[1];
+            break;
+            case HOST_CMD_SET_TX_POLICY:
+                if(size < 2 || cmd[1] > TX_POLICY_DROP_OLDEST)
+                {
+                    result = HOST_ACK_BAD_ARGUMENT;
+                    break;
+                }
+                txPolicy = cmd[1];
+            break;
+            case HOST_CMD_SET_THRESHOLD:
+                if(size < 4 || cmd[1] >= nbSensors)
+                {
+                    result = HOST_ACK_BAD_ARGUMENT;
+                    break;
+                }
+                sensorList[cmd[1]].threshold = readUint16(&cmd[2]);
+            break;
+            case HOST_CMD_SET_SENSOR_RATE:
+                if(size < 4 || cmd[1] >= nbSensors || cmd[2] == 0 ||
+                    cmd[3] > PRIORITY_LOW)
+                {
+                    result = HOST_ACK_BAD_ARGUMENT;
+                    break;
+                }
+                sensorList[cmd[1]].rateDivisor = cmd[2];
+                sensorList[cmd[1]].rateCounter = 0;
+                sensorList[cmd[1]].priority = cmd[3];
+            break;
+            default:
+                result = HOST_ACK_UNKNOWN_CMD;
+            break;
+        }
+        sendHostAck(cmd[0], result);
+    }
+}
+
+/*******************************************************************************
+* CY_ISR(cycleTimerIsr)
+*
+* Start of a cycle. The nodes are triggered right here: each one publishes the
+* scan it finished and starts the next, so the scans are taken at a constant
+* rate whatever the time the passes take.
+*******************************************************************************/
+CY_ISR(cycleTimerIsr)
+{
+    Timer_ClearInterrupt(Timer_INTR_MASK_TC);
+    
+    if(streaming)
+    {
+        startCapSenseAcquisition();
+    }
+    cycleCount++;
+}
+
+/*******************************************************************************
+* void startCycleTimer()
+*
+* Start the Timer that paces the cycles, with a period of cyclePeriod. The
+* clock divides HFCLK by the divider value plus one.
+*******************************************************************************/
+void startCycleTimer()
+{
+    Clock_SetDividerValue(CYDEV_BCLK__HFCLK__HZ / CYCLE_TIMER_FREQ - 1u);
+    Timer_Start();
+    setCyclePeriod(cyclePeriod);
+    Timer_Int_StartEx(cycleTimerIsr);
+}
+
+/*******************************************************************************
+* void setCyclePeriod(uint16 period)
+*
+* Change the cycle period. The current cycle is restarted.
+*
+* Param:
+*  - period: cycle period (ms), from 1 to MAX_CYCLE_PERIOD.
+*******************************************************************************/
+void setCyclePeriod(uint16 period)
+{
+    cyclePeriod = period;
+    Timer_WritePeriod((uint32)period * CYCLE_TICKS_PER_MS - 1u);
+    Timer_WriteCounter(0u);
+}
+
+/*******************************************************************************
+* void waitNextCycle()
+*
+* Wait for the start of the next cycle, handling the host commands in the
+* meantime. If cycles started while the last pass was running, they are lost:
+* they are counted in overrunCount and reported with HUB_MSG_OVERRUN. The I2C
+* recovery counters are sent when the bus was recovered since last reported.
+*******************************************************************************/
+void waitNextCycle()
+{
+    uint32 elapsed;
+    
+    do
+    {
+        processHostCommands();
+        elapsed = cycleCount - lastCycleCount;
+    } while(elapsed == 0);
+    
+    lastCycleCount += elapsed;
+    
+    if(elapsed > 1 && streaming)
+    {
+        uint8 msg[HUB_MSG_OVERRUN_SIZE];
+        uint32 missed = elapsed - 1;
+        
+        overrunCount += missed;
+        msg[0] = HUB_MSG_TAG;
+        msg[1] = HUB_MSG_OVERRUN;
+        writeUint16(&msg[2], (uint16)MIN(missed, 0xFFFFu));
+        writeUint32(&msg[4], overrunCount);
+        comm_putmsg(msg, sizeof(msg));
+    }
+    
+    for(uint8 bus=0; bus<I2C_SCHED_BUS_COUNT; ++bus)
+    {
+        I2CSchedStatsStruct stats;
+        i2c_sched_get_stats(bus, &stats);
+        if(stats.scbResets != reportedBusResets[bus])
+        {
+            sendBusStats(bus);
+        }
+    }
+    
+    comm_rx_stats_t linkStats;
+    comm_get_rx_stats(&linkStats);
+    if(linkStats.rxOverflows + linkStats.rxErrors + linkStats.msgRejected +
+        linkStats.msgTooLong + txDroppedNewest + txDroppedOldest != reportedLinkLosses)
+    {
+        sendLinkStats();
+    }
+}
+
+/*******************************************************************************
+* void comm_tick_callback()
+*
+* Called every COMM_TICK_US, by the comm interrupt when it polls the UART
+* (see cyapicallbacks.h) or by SysTick when the comm driver is event-driven,
+* it enforces the deadline of the I2C transfers, so no pass or enumeration
+* can hang on the bus.
+*
+*******************************************************************************/
+void comm_tick_callback()
+{
+    i2c_sched_tick(COMM_TICK_US);
+}
+
+int main(void)
+{
+    CyGlobalIntEnable;
+    comm_init();
+#if COMM_EVENT_DRIVEN
+    /* The comm driver leaves SysTick to us: tick the I2C deadlines */
+    CySysTickStart();
+    CySysTickSetReload(CYDEV_BCLK__SYSCLK__HZ / COMM_INTERRUPT_FREQ - 1u);
+    CySysTickSetCallback(0u, comm_tick_callback);
+#endif
+
+     /* Start the I2C Masters */
+    I2CM_Start();
+#if I2C_SCHED_BUS_COUNT > 1
+    I2CM2_Start();
+#endif
+    i2c_sched_init();
+    
+    // Let the nodes start, then find them on the bus
+    CyDelay(NODE_BOOT_DELAY);
+    enumerateSensors();
+    startCycleTimer();
+    
+    for(;;)
+    {    
+        // Wait for the trigger of the cycle, then read the scans it published
+        waitNextCycle();
+        
+        if(streaming)
+        {
+            readSensorsValues();
+        }
     }
 }
 
@@ -12,47 +12,386 @@
 
 #include "project.h"
 #include <stdbool.h>
+#include "i2c_scheduler.h"
+#include "comm_driver.h"
+#include "taxel_codec.h"
 
 
-#define NUMBER_OF_SENSORS   (0x16)
+#define NUMBER_OF_SENSORS   (0x16) // Maximum number of sensors on the bus
 #define TRANSFER_CMPLT      (0x00u)
 #define SLAVE_NOT_READY     (0x01u)
 #define TRANSFER_ERROR      (0xFFu)
 
+// Commands understood by the sensor nodes
+#define I2C_GENERAL_CALL_ADDR   (0x00u)
+#define NODE_CMD_START_SCAN     (0x01u)
+#define NODE_CMD_FREE_RUN       (0x02u)
+#define NODE_CMD_GET_DESCRIPTOR (0x03u)
+
+// Bus enumeration: at boot, the hub sends NODE_CMD_GET_DESCRIPTOR to every
+// address in [NODE_ADDR_FIRST, NODE_ADDR_LAST] of each I2C bus and reads back
+// the descriptor of the nodes that acknowledge it. The sensor messages are
+// tagged with the address, so an address already found on a bus is ignored
+// on the next ones. The CapSense tuner address of the nodes
+// (their address + 0x40) is above this range and never written.
+//  magic (NODE_DESCRIPTOR_MAGIC), register layout version,
+//  taxel count (uint16, little endian), sensor type, firmware version,
+//  capabilities (NODE_CAP_xxx), scan FIFO depth, record size (uint16)
+#define NODE_ADDR_FIRST         (0x08u)
+#define NODE_ADDR_LAST          (0x3Fu)
+#define NODE_DESCRIPTOR_SIZE    (10u)
+#define NODE_DESCRIPTOR_MAGIC   (0xB1u)
+#define NODE_LAYOUT_VERSION     (0x03u) // Sensor packet layout read by the hub
+#define DESCRIPTOR_READ_TRY     (5u)    // 1 ms apart
+#define NODE_BOOT_DELAY         (200u)  // ms, CapSense start-up of the nodes
+
+// Node capabilities. A node that supports Fast-mode Plus is read at 1 MHz;
+// after SPEED_FALLBACK_ERRORS failed transfers in a row, it falls back to
+// 400 kHz until the next enumeration. The general call and the enumeration
+// always use 400 kHz, so every node gets them.
+#define NODE_CAP_FAST_PLUS      (0x01u)
+#define SPEED_FALLBACK_ERRORS   (3u)
+
+// Sensor types of the node descriptors
+#define SENSOR_TYPE_UNKNOWN         (0x00u)
+#define SENSOR_TYPE_FINGERTIP       (0x01u)
+#define SENSOR_TYPE_MEDIAL_FRONT    (0x02u)
+#define SENSOR_TYPE_MEDIAL_BACK     (0x03u)
+#define SENSOR_TYPE_PROXIMAL_FRONT  (0x04u)
+#define SENSOR_TYPE_PROXIMAL_BACK   (0x05u)
+#define SENSOR_TYPE_THUMB_FRONT     (0x06u)
+#define SENSOR_TYPE_THUMB_BACK      (0x07u)
+#define SENSOR_TYPE_PALM            (0x08u)
+#define SENSOR_TYPE_BACK_OF_HAND    (0x09u)
+#define NB_SENSOR_TYPES             (0x0Au)
+
 #define SENSOR_BUFFER_SIZE  (300u)
 #define SENSOR_TAG_SIZE     1
 #define TIME_DATA_SIZE      4
-#define UART_BUFFER_SIZE    (SENSOR_TAG_SIZE + TIME_DATA_SIZE + SENSOR_BUFFER_SIZE)
 
-uint8 sensorValueBuffer[SENSOR_BUFFER_SIZE];
-uint8 uartBuffer[UART_BUFFER_SIZE];
+// Sensor packet (NODE_LAYOUT_VERSION), little endian, without padding:
+//  scans ready, layout version (NODE_LAYOUT_VERSION),
+//  scan sequence number (uint16), scan duration (uint32, node timer ticks),
+//  time (TIME_DATA_SIZE bytes), taxels (uint16)
+// A node keeps its last scans in a FIFO, one packet each, the record size of
+// its descriptor apart. A read starts at the oldest scan not read yet, and
+// the first byte tells how many scans can be read from there in the same
+// transfer (0 when there is no new scan). Every packet read is taken off the
+// FIFO. The header (scans ready, version and sequence number) is read alone
+// first, then as many packets as the slot holds in a single transfer.
+// The sequence number counts the scans of the node: a gap means scans were
+// lost because its FIFO was full.
+#define NODE_HEADER_SIZE    (4u)
+#define NODE_SEQUENCE_OFFSET (2u)
+#define NODE_PREFIX_SIZE    (NODE_HEADER_SIZE + 4u) // Bytes before the time
+
+// Read phases of a slot
+#define READ_PHASE_HEADER   (0u)
+#define READ_PHASE_DATA     (1u)
+
+// Encoding of the sensor messages (STREAM_PER_SENSOR mode)
+#define ENCODING_MODE_RAW   (0u) // Sensor address + time + taxels
+#define ENCODING_MODE_DELTA (1u) // Encoded messages, key or delta frames
+#define ENCODING_MODE_SPARSE (2u) // Encoded messages, key or sparse frames
+
+// Encoded sensor message:
+//  ENCODED_TAG_FLAG | sensor address
+//  ENCODING_KEY, ENCODING_DELTA or ENCODING_SPARSE
+//  frame counter of the sensor (uint8): a gap means a message was lost, and
+//  the deltas can't be applied until the next key frame
+//  time (TIME_DATA_SIZE bytes)
+//  ENCODING_KEY: taxels, as in the raw message
+//  ENCODING_DELTA: taxels delta encoded against the previous frame of the
+//                  sensor (see taxel_codec.h)
+//  ENCODING_SPARSE: (index, value) pairs of the taxels that moved by more
+//                   than the sensor threshold since they were last reported
+//                   (see taxel_codec.h)
+#define ENCODED_TAG_FLAG    (0x80u)
+#define ENCODING_KEY        (0x01u)
+#define ENCODING_DELTA      (0x02u)
+#define ENCODING_SPARSE     (0x03u)
+#define ENCODED_HEADER_SIZE (3u)
+#define ENCODED_MSG_MAX_SIZE (0xFFu - MSG_STRUCTURE_LENGTH)
+
+// A key frame is sent every KEY_FRAME_PERIOD frames of a sensor, so the host
+// can resynchronise (and gets a full refresh in sparse mode)
+#define KEY_FRAME_PERIOD    (32u)
+
+// Default change of a taxel needed to report it in sparse mode
+#define SPARSE_DEFAULT_THRESHOLD (20u)
+
+// Taxels of the previous frame, kept for the delta encoding (or the last
+// reported values, for the sparse encoding). The hub RAM
+// can't hold them for all sensors: the pool is given to the sensors in
+// sensorList order, and the ones that don't fit are sent as key frames.
+#define HISTORY_POOL_SIZE   (320u)
+
+// A slot receives the sensor packets (NODE_PREFIX_SIZE + TIME_DATA_SIZE + taxels
+// each) at SLOT_PACKET_OFFSET. Once checked, the message header and the sensor
+// tag (or the encoded message header) of each packet are written over the end
+// of its prefix and the footer after its taxels, and the messages are sent to
+// the UART straight from the slot.
+#define SLOT_PACKET_OFFSET  ((MSG_HEADER_LENGTH + ENCODED_HEADER_SIZE > NODE_PREFIX_SIZE) ? \
+                             (MSG_HEADER_LENGTH + ENCODED_HEADER_SIZE - NODE_PREFIX_SIZE) : 0u)
+#define SLOT_BUFFER_SIZE    (SLOT_PACKET_OFFSET + SENSOR_BUFFER_SIZE + MSG_FOOTER_LENGTH)
+#define PACKET_MSG_OFFSET   (NODE_PREFIX_SIZE - SENSOR_TAG_SIZE)
+#define PACKET_KEY_MSG_OFFSET (NODE_PREFIX_SIZE - ENCODED_HEADER_SIZE)
+
+// Number of slots: on each bus, one is filled by I2C while the other is sent
+// to the UART
+#define NB_READ_SLOTS       (2u * I2C_SCHED_BUS_COUNT)
+
+// Streaming modes
+#define STREAM_PER_SENSOR   (0u) // One message per sensor, tagged with its address
+#define STREAM_HAND_FRAME   (1u) // One long message per pass with all the sensors
+
+// What the acquisition does when the UART can't take the sensor messages as
+// fast as they are read (HOST_CMD_SET_TX_POLICY). With the drop policies the
+// passes never wait for the UART: the next frame of a sensor whose message is
+// dropped is a key frame, and a hand frame is dropped whole.
+#define TX_POLICY_BLOCK       (0u) // Wait for room, nothing is lost
+#define TX_POLICY_DROP_NEWEST (1u) // Drop the message that doesn't fit
+#define TX_POLICY_DROP_OLDEST (2u) // Withdraw the oldest queued messages
+
+// Hand frame (long message), sent in STREAM_HAND_FRAME mode:
+//  HUB_MSG_TAG, HUB_MSG_HAND_FRAME
+//  frame sequence number (uint16, little endian)
+//  present bitmap (uint32, little endian, bit i = sensorList[i])
+//  for each present sensor, in sensorList order: time + taxels
+//  failed bitmap (uint32, little endian): present sensors whose packet could
+//  not be read after all, sent as zeros
+#define HUB_MSG_TAG             (0x00u)
+#define HUB_MSG_HAND_FRAME      (0x01u)
+#define HAND_FRAME_HEADER_SIZE  (8u)
+#define HAND_FRAME_FOOTER_SIZE  (4u)
+
+// Commands from the host (comm_getmsg), first byte of the message then the
+// arguments, little endian. Each command is answered with HUB_MSG_ACK, except
+// HOST_CMD_GET_STATUS that is answered with HUB_MSG_STATUS,
+// HOST_CMD_GET_HEALTH that is answered with HUB_MSG_HEALTH and
+// HOST_CMD_GET_SENSORS that is answered with HUB_MSG_SENSOR_LIST,
+// HOST_CMD_GET_BUS_STATS that is answered with HUB_MSG_BUS_STATS and
+// HOST_CMD_GET_LINK_STATS that is answered with HUB_MSG_LINK_STATS.
+#define HOST_CMD_START              (0x01u) // Start streaming
+#define HOST_CMD_STOP               (0x02u) // Stop streaming
+#define HOST_CMD_SET_SENSOR_MASK    (0x03u) // uint32: bit i enables sensorList[i]
+#define HOST_CMD_SET_PERIOD         (0x04u) // uint16: cycle period (ms)
+#define HOST_CMD_SET_ENCODING       (0x05u) // uint8: ENCODING_MODE_xxx
+#define HOST_CMD_GET_STATUS         (0x06u)
+#define HOST_CMD_SET_STREAM_MODE    (0x07u) // uint8: STREAM_xxx
+#define HOST_CMD_SET_THRESHOLD      (0x08u) // uint8: sensor index, uint16: threshold
+#define HOST_CMD_SET_SENSOR_RATE    (0x09u) // uint8: sensor index, uint8: rate
+                                            // divisor, uint8: PRIORITY_xxx
+#define HOST_CMD_GET_HEALTH         (0x0Au)
+#define HOST_CMD_GET_SENSORS        (0x0Bu)
+#define HOST_CMD_ENUMERATE          (0x0Cu) // Probe the bus again
+#define HOST_CMD_GET_BUS_STATS      (0x0Du)
+#define HOST_CMD_GET_LINK_STATS     (0x0Eu)
+#define HOST_CMD_SET_TX_POLICY      (0x0Fu) // uint8: TX_POLICY_xxx
+#define HOST_CMD_MAX_SIZE           (100u)
+
+// Answers to the host commands
+//  HUB_MSG_TAG, HUB_MSG_ACK, command, HOST_ACK_xxx
+//  HUB_MSG_TAG, HUB_MSG_STATUS, streaming, streamMode, encodingMode,
+//  cycle period (uint16), enabled sensors (uint32), online sensors (uint32),
+//  frame sequence number (uint16), overrun cycles (uint32)
+#define HUB_MSG_STATUS          (0x02u)
+#define HUB_MSG_ACK             (0x03u)
+#define HUB_MSG_STATUS_SIZE     (21u)
+#define HOST_ACK_OK             (0x00u)
+#define HOST_ACK_UNKNOWN_CMD    (0x01u)
+#define HOST_ACK_BAD_ARGUMENT   (0x02u)
+
+// Cycles are started by the Timer terminal count. Timer is clocked by Clock,
+// set to CYCLE_TIMER_FREQ, and its interrupt is connected to Timer_Int.
+#define DEFAULT_CYCLE_PERIOD    (10u) // ms
+#define CYCLE_TIMER_FREQ        (10000u) // Hz
+#define CYCLE_TICKS_PER_MS      (CYCLE_TIMER_FREQ / 1000u)
+#define MAX_CYCLE_PERIOD        (0xFFFFu / CYCLE_TICKS_PER_MS) // ms, 16-bit Timer
+
+// Priority classes: in a pass, the sensors of a class are read before the
+// ones of the next class
+#define PRIORITY_HIGH           (0u)
+#define PRIORITY_NORMAL         (1u)
+#define PRIORITY_LOW            (2u)
+
+// Sent when cycles were missed because a pass took longer than the period
+//  HUB_MSG_TAG, HUB_MSG_OVERRUN, missed cycles (uint16), total (uint32)
+#define HUB_MSG_OVERRUN         (0x04u)
+#define HUB_MSG_OVERRUN_SIZE    (8u)
+
+// Health of the sensors. A sensor that doesn't answer its address in
+// SENSOR_OFFLINE_FAILURES passes in a row is put offline. An offline sensor
+// is only probed with a single header read, after 1, 2, 4... cycles, up to
+// 2^MAX_PROBE_SHIFT cycles between probes, and is put back online as soon as
+// it answers. Otherwise, a sensor is read up to MAX_READ_TRY times per pass.
+#define MAX_READ_TRY            (5u)
+#define SENSOR_OFFLINE_FAILURES (3u)
+#define MAX_PROBE_SHIFT         (8u)
+
+// Sent when a sensor goes offline or back online, and on HOST_CMD_GET_HEALTH
+//  HUB_MSG_TAG, HUB_MSG_HEALTH, cycle (uint32)
+//  for each sensor, in sensorList order: online, consecutive failed passes,
+//  cycles since it last answered (uint16, saturated)
+#define HUB_MSG_HEALTH          (0x05u)
+#define HEALTH_HEADER_SIZE      (6u)
+#define HEALTH_ENTRY_SIZE       (4u)
+#define HUB_MSG_HEALTH_MAX_SIZE (HEALTH_HEADER_SIZE + HEALTH_ENTRY_SIZE*NUMBER_OF_SENSORS)
+
+// Sensors found by the enumeration, sent after each enumeration and on
+// HOST_CMD_GET_SENSORS. Their order is the sensorList order used by the
+// bitmaps of the other messages.
+//  HUB_MSG_TAG, HUB_MSG_SENSOR_LIST, number of sensors
+//  for each sensor: address, sensor type, taxel count (uint16),
+//  firmware version, I2C bus, capabilities, I2C speed (I2C_SPEED_xxx)
+// It is also sent when a sensor falls back to a lower speed.
+#define HUB_MSG_SENSOR_LIST     (0x06u)
+#define SENSOR_LIST_HEADER_SIZE (3u)
+#define SENSOR_LIST_ENTRY_SIZE  (8u)
+#define HUB_MSG_SENSOR_LIST_MAX_SIZE (SENSOR_LIST_HEADER_SIZE + SENSOR_LIST_ENTRY_SIZE*NUMBER_OF_SENSORS)
+
+// I2C recovery counters of a bus (see i2c_scheduler.h), sent after a cycle in
+// which the bus was recovered and, for each bus, on HOST_CMD_GET_BUS_STATS
+//  HUB_MSG_TAG, HUB_MSG_BUS_STATS, bus, timeouts, bus errors, SCB resets,
+//  SDA clock-outs, stuck bus (uint32 each)
+#define HUB_MSG_BUS_STATS       (0x07u)
+#define HUB_MSG_BUS_STATS_SIZE  (23u)
+
+// Counters of the host link (see comm_driver.h and TX_POLICY_xxx), sent after
+// a cycle in which received bytes or commands were lost or sensor messages
+// were dropped, and on HOST_CMD_GET_LINK_STATS
+//  HUB_MSG_TAG, HUB_MSG_LINK_STATS, RX bytes, RX buffer full, RX FIFO
+//  overflows, RX frame errors, TX messages that waited, TX messages dropped
+//  (newest), TX messages withdrawn (oldest), commands received, bytes
+//  skipped, bad starts of command, commands longer than HOST_CMD_MAX_SIZE
+//  (uint32 each)
+#define HUB_MSG_LINK_STATS      (0x08u)
+#define HUB_MSG_LINK_STATS_SIZE (46u)
+
+// findNextSensorToRead() on any bus
+#define I2C_BUS_ANY             (0xFFu)
 
 typedef struct
 {
+    uint8 bus;              // I2C bus of the sensor
     uint16 i2cAddr;
     uint8 nbTaxels;
+    uint8 sensorType;       // SENSOR_TYPE_xxx, from the node descriptor
+    uint8 firmwareVersion;
+    uint8 capabilities;     // NODE_CAP_xxx
+    uint8 speed;            // I2C_SPEED_xxx of its transfers
+    uint8 speedErrors;      // Failed transfers in a row at this speed
     bool isOnline;
+    bool isEnabled;
     bool wasRead;
+    bool isReading;
+    bool isReady;
     uint8 nbReadTry;
+    uint16 lastSequence;    // Sequence number of the last scan read
+    uint8 maxPackets;       // Packets read in one transfer at most: FIFO depth
+                            // of the node, limited by the slot size
+    uint16 recordSize;      // Bytes between two packets of a read
+    uint16* history;        // Previous frame for the delta encoding, or NULL
+    uint16 threshold;       // Sparse encoding threshold
+    bool historyValid;
+    uint8 frameCounter;
+    uint8 framesSinceKey;
+    uint8 rateDivisor;      // Read every rateDivisor cycles
+    uint8 rateCounter;      // Cycles before the next read
+    uint8 priority;         // PRIORITY_xxx
+    bool isDue;             // To be read in this pass
+    bool hasAnswered;       // Acknowledged a read in this pass
+    bool wasDropped;        // Not read in this pass, TX_POLICY_DROP_NEWEST
+    uint8 nbFailures;       // Passes in a row without an answer
+    uint8 probeShift;       // Offline: 2^probeShift cycles between probes
+    uint16 probeCounter;    // Offline: cycles before the next probe
+    uint32 lastSeenCycle;   // Last cycle the sensor answered
     
 } SensorInfoStruct;
 
+typedef struct
+{
+    I2CJobStruct job;
+    uint8 sensorIndex;
+    uint8 phase;
+    uint8 nbPackets;        // Packets read in READ_PHASE_DATA
+    uint8 buffer[SLOT_BUFFER_SIZE];
+} ReadSlotStruct;
+
 SensorInfoStruct sensorList[NUMBER_OF_SENSORS];
+uint8 nbSensors = 0;
+bool sensorListChanged = false;
+ReadSlotStruct readSlots[NB_READ_SLOTS];
+
+I2CJobStruct triggerJobs[I2C_SCHED_BUS_COUNT];
+uint8 triggerCommand;
+
+bool streaming = true;
+uint16 cyclePeriod = DEFAULT_CYCLE_PERIOD;
+volatile uint32 cycleCount = 0;
+uint32 lastCycleCount = 0;
+uint32 overrunCount = 0;
+uint32 reportedBusResets[I2C_SCHED_BUS_COUNT];
+uint32 reportedLinkLosses = 0;
+uint8 txPolicy = TX_POLICY_BLOCK;
+uint32 txBlockedMessages = 0;
+uint32 txDroppedNewest = 0;
+uint32 txDroppedOldest = 0;
+uint8 streamMode = STREAM_PER_SENSOR;
+uint8 encodingMode = ENCODING_MODE_RAW;
+uint16 historyPool[HISTORY_POOL_SIZE];
+uint16 frameSequence = 0;
 
-uint16 sensorAddrList[] = 
-    {0x17, 0x18, 0x19, 0x1A, 0x1B, 0x1C, 0x1D, 0x08, 0x09, 0x0A, 0x0B, 
-     0x0C, 0x0D, 0x0E, 0x0F, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16};
+// Default rate divisor and priority class of each SENSOR_TYPE_xxx: the
+// fingertips are read every cycle first, the palm and the back of the hand
+// (large and slow-changing) every 4 cycles
+uint8 typeRateDivisorList[NB_SENSOR_TYPES] = 
+    {1, 1, 1, 1, 1, 1, 1, 1, 4, 4};
 
-uint16 nbTaxelList[] = 
-    {66, 27, 65, 30, 78, 66, 27, 65, 30, 78, 66, 
-     27, 65, 30, 78, 66, 20, 20, 20, 20, 121, 118};
+uint8 typePriorityList[NB_SENSOR_TYPES] = 
+    {PRIORITY_NORMAL, PRIORITY_HIGH, PRIORITY_NORMAL, PRIORITY_NORMAL,
+     PRIORITY_NORMAL, PRIORITY_NORMAL, PRIORITY_HIGH, PRIORITY_NORMAL,
+     PRIORITY_LOW, PRIORITY_LOW};
     
-uint32 readSensor(const SensorInfoStruct* sensor);
+void startSensorRead(ReadSlotStruct* slot, uint8 index, uint8 phase, uint8 nbPackets);
+uint32 getSensorReadStatus(const ReadSlotStruct* slot);
 uint32 startCapSenseAcquisition();
+bool runBlockingJob(I2CJobStruct* job);
+bool readNodeDescriptor(uint8 bus, uint8 i2cAddr, uint8* descriptor);
+void enumerateSensors();
+void sendSensorList();
+void updateSensorSpeed(SensorInfoStruct* sensor, uint32 result);
+int findSensorByAddress(uint8 i2cAddr);
+int findNextSensorToRead(uint8 first, uint8 bus);
+uint8 findIdleBus();
+void writeUint16(uint8* dest, uint16 value);
+void writeUint32(uint8* dest, uint32 value);
+uint16 readUint16(const uint8* src);
+uint32 readUint32(const uint8* src);
+bool isNewSequence(const SensorInfoStruct* sensor, uint16 sequence);
 void initSensorsStructs();
 void resetSensorsReadStatus();
+void scheduleSensors();
+void updateSensorsHealth();
+void sendSensorsHealth();
+void sendBusStats(uint8 bus);
+void sendLinkStats();
+void readSensors(uint8 lastPhase);
+void sendHandFrame();
 void readSensorsValues();
-void sendDataToUART(const SensorInfoStruct* sensor);
+void processHostCommands();
+void startCycleTimer();
+void setCyclePeriod(uint16 period);
+void waitNextCycle();
+void sendHostAck(uint8 command, uint8 result);
+void sendHubStatus();
+bool isSlotFree(const ReadSlotStruct* slot);
+bool isTxBackedUp();
+bool dropOldestMessage();
+bool sendStreamMessage(SensorInfoStruct* sensor, const comm_iovec_t* iov, uint8 n, bool inPlace);
+void sendDataToUART(SensorInfoStruct* sensor, uint8* packet);
+void sendEncodedDataToUART(SensorInfoStruct* sensor, uint8* packet);
+void sendSlotPackets(SensorInfoStruct* sensor, ReadSlotStruct* slot);
 int main(void);
     
 /* [] END OF FILE */
@@ -0,0 +1,355 @@
+/* ========================================
+ *
+ * Copyright YOUR COMPANY, THE YEAR
+ * All Rights Reserved
+ * UNPUBLISHED, LICENSED SOFTWARE.
+ *
+ * CONFIDENTIAL AND PROPRIETARY INFORMATION
+ * WHICH IS THE PROPERTY OF your company.
+ *
+ * ========================================
+*/
+#include "spsc_ring.h"
+#include <string.h>
+
+/*******************************************************************************
+* MACROS
+*******************************************************************************/
+// Keep the compiler from moving the storage accesses across an index access.
+// The Cortex-M0 has a single core, no cache and runs in order, so nothing
+// else is needed between an interrupt and the main loop.
+#define _SPSC_RING_BARRIER() __asm__ volatile ("" ::: "memory")
+
+/*******************************************************************************
+* PRIVATE PROTOTYPES
+*******************************************************************************/
+uint32_t _spsc_ring_used(const spsc_ring_t *ring);
+
+
+/*******************************************************************************
+* PUBLIC FUNCTIONS
+*******************************************************************************/
+/*******************************************************************************
+* Function Name: spsc_ring_size
+********************************************************************************
+* Summary:
+*  Get the capacity of a ring.
+*
+* Parameters:
+*  ring: The ring.
+*
+* Return:
+*  uint32_t: The number of bytes the ring can hold.
+*
+*******************************************************************************/
+uint32_t spsc_ring_size(const spsc_ring_t *ring)
+{
+    return ring->mask + 1u;
+}
+
+/*******************************************************************************
+* Function Name: spsc_ring_used
+********************************************************************************
+* Summary:
+*  Get the number of bytes in a ring. Seen from the consumer it can only grow
+*  until the consumer reads, seen from the producer it can only shrink until
+*  the producer writes.
+*
+* Parameters:
+*  ring: The ring.
+*
+* Return:
+*  uint32_t: The number of bytes waiting to be read.
+*
+*******************************************************************************/
+uint32_t spsc_ring_used(const spsc_ring_t *ring)
+{
+    return _spsc_ring_used(ring);
+}
+
+/*******************************************************************************
+* Function Name: spsc_ring_free
+********************************************************************************
+* Summary:
+*  Get the number of bytes that can be written in a ring.
+*
+* Parameters:
+*  ring: The ring.
+*
+* Return:
+*  uint32_t: The number of free bytes.
+*
+*******************************************************************************/
+uint32_t spsc_ring_free(const spsc_ring_t *ring)
+{
+    return spsc_ring_size(ring) - _spsc_ring_used(ring);
+}
+
+/*******************************************************************************
+* Function Name: spsc_ring_write
+********************************************************************************
+* Summary:
+*  Copy bytes into a ring, as many as there is room for. Producer only.
+*
+* Parameters:
+*  ring: The ring.
+*  data: The bytes to copy.
+*  count: The number of bytes to copy.
+*
+* Return:
+*  uint32_t: The number of bytes copied.
+*
+*******************************************************************************/
+uint32_t spsc_ring_write(spsc_ring_t *ring, const void *data, uint32_t count)
+{
+    uint32_t space = spsc_ring_free(ring);
+    if(count > space)
+        count = space;
+
+    uint32_t index = ring->head & ring->mask;
+    uint32_t first = spsc_ring_size(ring) - index;
+    if(first > count)
+        first = count;
+
+    memcpy(ring->buf + index, data, first);
+    if(count > first)
+        memcpy(ring->buf, (const uint8_t *)data + first, count - first);
+
+    spsc_ring_commit(ring, count);
+    return count;
+}
+
+/*******************************************************************************
+* Function Name: spsc_ring_write_span
+********************************************************************************
+* Summary:
+*  Get the free bytes of a ring that are contiguous in its storage, to be
+*  filled in place and then given to spsc_ring_commit(). Producer only.
+*
+* Parameters:
+*  ring: The ring.
+*  span: Set to the first free byte.
+*
+* Return:
+*  uint32_t: The number of contiguous free bytes at 'span'.
+*
+*******************************************************************************/
+uint32_t spsc_ring_write_span(spsc_ring_t *ring, uint8_t **span)
+{
+    uint32_t space = spsc_ring_free(ring);
+    uint32_t index = ring->head & ring->mask;
+    uint32_t contiguous = spsc_ring_size(ring) - index;
+
+    *span = ring->buf + index;
+    return (space < contiguous) ? space : contiguous;
+}
+
+/*******************************************************************************
+* Function Name: spsc_ring_commit
+********************************************************************************
+* Summary:
+*  Make bytes filled in place (see spsc_ring_write_span()) available to the
+*  consumer. Producer only.
+*
+* Parameters:
+*  ring: The ring.
+*  count: The number of bytes filled. Must not exceed the free bytes.
+*
+* Return:
+*  None.
+*
+*******************************************************************************/
+void spsc_ring_commit(spsc_ring_t *ring, uint32_t count)
+{
+    // The bytes are in the storage before the consumer can see them
+    _SPSC_RING_BARRIER();
+    ring->head += count;
+}
+
+/*******************************************************************************
+* Function Name: spsc_ring_read
+********************************************************************************
+* Summary:
+*  Copy bytes out of a ring and remove them, as many as there are.
+*  Consumer only.
+*
+* Parameters:
+*  ring: The ring.
+*  data: Where to copy the bytes.
+*  count: The number of bytes to copy.
+*
+* Return:
+*  uint32_t: The number of bytes copied.
+*
+*******************************************************************************/
+uint32_t spsc_ring_read(spsc_ring_t *ring, void *data, uint32_t count)
+{
+    uint32_t used = _spsc_ring_used(ring);
+    if(count > used)
+        count = used;
+
+    uint32_t index = ring->tail & ring->mask;
+    uint32_t first = spsc_ring_size(ring) - index;
+    if(first > count)
+        first = count;
+
+    memcpy(data, ring->buf + index, first);
+    if(count > first)
+        memcpy((uint8_t *)data + first, ring->buf, count - first);
+
+    spsc_ring_skip(ring, count);
+    return count;
+}
+
+/*******************************************************************************
+* Function Name: spsc_ring_read_span
+********************************************************************************
+* Summary:
+*  Get the bytes of a ring that are contiguous in its storage, to be used in
+*  place and then removed with spsc_ring_skip(). Consumer only.
+*
+* Parameters:
+*  ring: The ring.
+*  span: Set to the oldest byte.
+*
+* Return:
+*  uint32_t: The number of contiguous bytes at 'span'.
+*
+*******************************************************************************/
+uint32_t spsc_ring_read_span(const spsc_ring_t *ring, const uint8_t **span)
+{
+    uint32_t used = _spsc_ring_used(ring);
+    uint32_t index = ring->tail & ring->mask;
+    uint32_t contiguous = spsc_ring_size(ring) - index;
+
+    *span = ring->buf + index;
+    return (used < contiguous) ? used : contiguous;
+}
+
+/*******************************************************************************
+* Function Name: spsc_ring_skip
+********************************************************************************
+* Summary:
+*  Remove bytes from a ring without copying them. Consumer only.
+*
+* Parameters:
+*  ring: The ring.
+*  count: The number of bytes to remove. Limited to the bytes in the ring.
+*
+* Return:
+*  None.
+*
+*******************************************************************************/
+void spsc_ring_skip(spsc_ring_t *ring, uint32_t count)
+{
+    uint32_t used = _spsc_ring_used(ring);
+    if(count > used)
+        count = used;
+
+    // The bytes are read before the producer can overwrite them
+    _SPSC_RING_BARRIER();
+    ring->tail += count;
+}
+
+/*******************************************************************************
+* Function Name: spsc_ring_flush
+********************************************************************************
+* Summary:
+*  Remove all the bytes of a ring. Consumer only.
+*
+* Parameters:
+*  ring: The ring.
+*
+* Return:
+*  None.
+*
+*******************************************************************************/
+void spsc_ring_flush(spsc_ring_t *ring)
+{
+    ring->tail = ring->head;
+}
+
+/*******************************************************************************
+* Function Name: spsc_ring_peek
+********************************************************************************
+* Summary:
+*  Read a byte of a ring without removing it. Consumer only.
+*
+* Parameters:
+*  ring: The ring.
+*  offset: Position of the byte from the oldest one. Must be lower than
+*          spsc_ring_used().
+*
+* Return:
+*  uint8_t: The byte.
+*
+*******************************************************************************/
+uint8_t spsc_ring_peek(const spsc_ring_t *ring, uint32_t offset)
+{
+    return ring->buf[(ring->tail + offset) & ring->mask];
+}
+
+/*******************************************************************************
+* Function Name: spsc_ring_find
+********************************************************************************
+* Summary:
+*  Find the first occurrence of a byte in a ring. Consumer only.
+*
+* Parameters:
+*  ring: The ring.
+*  c: The byte to find.
+*  offset: Position from the oldest byte where the search starts.
+*
+* Return:
+*  uint32_t: Position of the byte from the oldest one, SPSC_RING_NOT_FOUND
+*            if it isn't in the ring.
+*
+*******************************************************************************/
+uint32_t spsc_ring_find(const spsc_ring_t *ring, uint8_t c, uint32_t offset)
+{
+    uint32_t used = _spsc_ring_used(ring);
+
+    // Search the contiguous spans one after the other
+    while(offset < used) {
+        uint32_t index = (ring->tail + offset) & ring->mask;
+        uint32_t count = spsc_ring_size(ring) - index;
+        if(count > used - offset)
+            count = used - offset;
+
+        const uint8_t *found = memchr(ring->buf + index, c, count);
+        if(found)
+            return offset + (uint32_t)(found - (ring->buf + index));
+        offset += count;
+    }
+
+    return SPSC_RING_NOT_FOUND;
+}
+
+
+/*******************************************************************************
+* PRIVATE FUNCTIONS
+*******************************************************************************/
+/*******************************************************************************
+* Function Name: _spsc_ring_used
+********************************************************************************
+* Summary:
+*  Get the number of bytes in a ring, before any access to the storage that
+*  depends on it.
+*
+* Parameters:
+*  ring: The ring.
+*
+* Return:
+*  uint32_t: The number of bytes waiting to be read.
+*
+*******************************************************************************/
+uint32_t _spsc_ring_used(const spsc_ring_t *ring)
+{
+    uint32_t used = ring->head - ring->tail;
+
+    // The indexes are read before the storage they cover
+    _SPSC_RING_BARRIER();
+    return used;
+}
+
+/* [] END OF FILE */
@@ -0,0 +1,90 @@
+/* ========================================
+ *
+ * Copyright YOUR COMPANY, THE YEAR
+ * All Rights Reserved
+ * UNPUBLISHED, LICENSED SOFTWARE.
+ *
+ * CONFIDENTIAL AND PROPRIETARY INFORMATION
+ * WHICH IS THE PROPERTY OF your company.
+ *
+ * ========================================
+ *
+ * Summary:
+ *  Single-producer/single-consumer byte ring, for one side in an interrupt
+ *  and the other in the main loop. No side ever disables the interrupts:
+ *  the producer only writes 'head', the consumer only writes 'tail', and
+ *  each side publishes its index after the bytes it covers.
+ *  The storage is static (SPSC_RING_DEFINE) and its size is a power of two,
+ *  so indexes wrap with a mask instead of a division (the Cortex-M0 has no
+ *  divider). The indexes run freely and are only masked to address the
+ *  storage: head - tail is the number of bytes used, and all 'size' bytes
+ *  are usable.
+ *  Bytes are copied in contiguous spans (one or two memcpy per call), and
+ *  the span functions give direct access to the storage for zero-copy
+ *  transfers.
+ *
+ *  Plain C99 without PSoC headers, so it also builds on the host
+ *  (see host/ring_bench.c).
+ *
+ * Usage:
+ *  SPSC_RING_DEFINE(myRing, 256u);
+ *  spsc_ring_write(&myRing, data, count);  // producer
+ *  spsc_ring_read(&myRing, data, count);   // consumer
+ *
+ * ========================================
+*/
+
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*******************************************************************************
+* MACROS
+*******************************************************************************/
+// Returned by spsc_ring_find() when the byte isn't in the ring
+#define SPSC_RING_NOT_FOUND (0xFFFFFFFFu)
+
+// Define a ring and its storage. 'size' must be a power of two.
+#define SPSC_RING_DEFINE(name, size) \
+    typedef char name##_size_must_be_a_power_of_two \
+        [((size) != 0u && ((size) & ((size) - 1u)) == 0u) ? 1 : -1]; \
+    static uint8_t name##_storage[(size)]; \
+    spsc_ring_t name = {name##_storage, (size) - 1u, 0u, 0u}
+
+/*******************************************************************************
+* PUBLIC TYPES
+*******************************************************************************/
+typedef struct
+{
+    uint8_t *buf;
+    uint32_t mask;              // Size of buf - 1
+    volatile uint32_t head;     // Bytes ever written, producer only
+    volatile uint32_t tail;     // Bytes ever read, consumer only
+} spsc_ring_t;
+
+/*******************************************************************************
+* PUBLIC PROTOTYPES
+*******************************************************************************/
+// Both sides
+uint32_t spsc_ring_size(const spsc_ring_t *ring);
+uint32_t spsc_ring_used(const spsc_ring_t *ring);
+uint32_t spsc_ring_free(const spsc_ring_t *ring);
+
+// Producer
+uint32_t spsc_ring_write(spsc_ring_t *ring, const void *data, uint32_t count);
+uint32_t spsc_ring_write_span(spsc_ring_t *ring, uint8_t **span);
+void spsc_ring_commit(spsc_ring_t *ring, uint32_t count);
+
+// Consumer
+uint32_t spsc_ring_read(spsc_ring_t *ring, void *data, uint32_t count);
+uint32_t spsc_ring_read_span(const spsc_ring_t *ring, const uint8_t **span);
+void spsc_ring_skip(spsc_ring_t *ring, uint32_t count);
+void spsc_ring_flush(spsc_ring_t *ring);
+uint8_t spsc_ring_peek(const spsc_ring_t *ring, uint32_t offset);
+uint32_t spsc_ring_find(const spsc_ring_t *ring, uint8_t c, uint32_t offset);
+
+#endif // SPSC_RING_H
+
+/* [] END OF FILE */
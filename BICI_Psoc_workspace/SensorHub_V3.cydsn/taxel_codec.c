@@ -0,0 +1,180 @@
+/* ========================================
+ *
+ * Copyright YOUR COMPANY, THE YEAR
+ * All Rights Reserved
+ * UNPUBLISHED, LICENSED SOFTWARE.
+ *
+ * CONFIDENTIAL AND PROPRIETARY INFORMATION
+ * WHICH IS THE PROPERTY OF your company.
+ *
+ * ========================================
+*/
+#include "taxel_codec.h"
+
+/*******************************************************************************
+* MACROS
+*******************************************************************************/
+#define TAXEL(taxels, i)    ((uint16_t)((taxels)[2*(i)] | ((taxels)[2*(i)+1] << 8)))
+
+
+/*******************************************************************************
+* PRIVATE PROTOTYPES
+*******************************************************************************/
+uint8_t _taxel_codec_put_varint(uint8_t *out, uint32_t value);
+
+
+/*******************************************************************************
+* PUBLIC FUNCTIONS
+*******************************************************************************/
+/*******************************************************************************
+* Function Name: taxel_codec_delta
+********************************************************************************
+* Summary:
+*  Delta encode the taxels of a frame against the previous frame of the same
+*  sensor (see taxel_codec.h). Stops as soon as the result would not fit in
+*  maxSize bytes.
+*
+* Parameters:
+*  previous: Taxels of the previous frame, as stored by taxel_codec_store().
+*  taxels: Taxels of the new frame (little endian).
+*  nbTaxels: The number of taxels.
+*  out: Buffer receiving the encoded taxels.
+*  maxSize: The size of 'out'.
+*
+* Return:
+*  uint16_t: The number of bytes written, or TAXEL_CODEC_NO_FIT if they don't
+*          fit in maxSize.
+*
+*******************************************************************************/
+uint16_t taxel_codec_delta(const uint16_t *previous, const uint8_t *taxels,
+                           uint8_t nbTaxels, uint8_t *out, uint16_t maxSize)
+{
+    uint16_t count = 0;
+    uint8_t i = 0;
+    
+    while(i < nbTaxels) {
+        if(count + 2*TAXEL_CODEC_VARINT_MAX_SIZE > maxSize)
+            return TAXEL_CODEC_NO_FIT;
+        
+        int32_t delta = (int32_t)TAXEL(taxels, i) - (int32_t)previous[i];
+        i++;
+        
+        // Zig-zag encoding, small differences give small values
+        count += _taxel_codec_put_varint(out + count, ((uint32_t)delta << 1) ^ (uint32_t)(delta >> 31));
+        
+        // A zero is followed by the number of further unchanged taxels
+        if(delta == 0) {
+            uint8_t run = 0;
+            while(i < nbTaxels && TAXEL(taxels, i) == previous[i]) {
+                run++;
+                i++;
+            }
+            count += _taxel_codec_put_varint(out + count, run);
+        }
+    }
+    
+    return count;
+}
+
+/*******************************************************************************
+* Function Name: taxel_codec_sparse
+********************************************************************************
+* Summary:
+*  Sparse encode the taxels of a frame (see taxel_codec.h): write the taxels
+*  that moved by more than 'threshold' since they were last reported, and
+*  update their reported value. When the result doesn't fit, 'reported' is
+*  left partly updated: the caller must send all the taxels and store them
+*  with taxel_codec_store().
+*
+* Parameters:
+*  reported: Last reported value of each taxel.
+*  taxels: Taxels of the new frame (little endian).
+*  nbTaxels: The number of taxels.
+*  threshold: Minimum change of a taxel to report it again.
+*  out: Buffer receiving the (index, value) pairs.
+*  maxSize: The size of 'out'.
+*
+* Return:
+*  uint16_t: The number of bytes written (0 if no taxel moved), or
+*          TAXEL_CODEC_NO_FIT if they don't fit in maxSize.
+*
+*******************************************************************************/
+uint16_t taxel_codec_sparse(uint16_t *reported, const uint8_t *taxels,
+                            uint8_t nbTaxels, uint16_t threshold,
+                            uint8_t *out, uint16_t maxSize)
+{
+    uint16_t count = 0;
+    
+    for(uint8_t i = 0; i < nbTaxels; i++) {
+        uint16_t value = TAXEL(taxels, i);
+        uint16_t change = (value > reported[i]) ? value - reported[i] : reported[i] - value;
+        
+        if(change <= threshold)
+            continue;
+        
+        if(count + TAXEL_CODEC_PAIR_SIZE > maxSize)
+            return TAXEL_CODEC_NO_FIT;
+        
+        out[count++] = i;
+        out[count++] = taxels[2*i];
+        out[count++] = taxels[2*i+1];
+        reported[i] = value;
+    }
+    
+    return count;
+}
+
+/*******************************************************************************
+* Function Name: taxel_codec_store
+********************************************************************************
+* Summary:
+*  Keep the taxels of a frame as the reference for the next delta encoding.
+*
+* Parameters:
+*  previous: Buffer of nbTaxels values receiving the taxels.
+*  taxels: Taxels of the frame (little endian).
+*  nbTaxels: The number of taxels.
+*
+* Return:
+*  None.
+*
+*******************************************************************************/
+void taxel_codec_store(uint16_t *previous, const uint8_t *taxels, uint8_t nbTaxels)
+{
+    for(uint8_t i = 0; i < nbTaxels; i++) {
+        previous[i] = TAXEL(taxels, i);
+    }
+}
+
+
+/*******************************************************************************
+* PRIVATE FUNCTIONS
+*******************************************************************************/
+/*******************************************************************************
+* Function Name: _taxel_codec_put_varint
+********************************************************************************
+* Summary:
+*  Write a value as a varint.
+*
+* Parameters:
+*  out: Buffer receiving the varint.
+*  value: The value to write.
+*
+* Return:
+*  uint8_t: The number of bytes written.
+*
+*******************************************************************************/
+uint8_t _taxel_codec_put_varint(uint8_t *out, uint32_t value)
+{
+    uint8_t count = 0;
+    
+    while(value >= 0x80u) {
+        out[count++] = (uint8_t)(value | 0x80u);
+        value >>= 7;
+    }
+    out[count++] = (uint8_t)value;
+    
+    return count;
+}
+
+/* [] END OF FILE */
@@ -0,0 +1,64 @@
+/* ========================================
+ *
+ * Copyright YOUR COMPANY, THE YEAR
+ * All Rights Reserved
+ * UNPUBLISHED, LICENSED SOFTWARE.
+ *
+ * CONFIDENTIAL AND PROPRIETARY INFORMATION
+ * WHICH IS THE PROPERTY OF your company.
+ *
+ * ========================================
+ *
+ * Summary:
+ *  Compact encodings of the taxels of a sensor, used to send more frames on
+ *  the UART link. Taxels are given as read from the sensor: uint16_t
+ *  values, little endian.
+ *
+ *  Plain C99 without PSoC headers, so it also builds on the host
+ *  (see host/taxel_codec_test.cpp).
+ *
+ * Delta encoding:
+ *  For each taxel, the difference with the previous frame is zig-zag encoded
+ *  (0, -1, 1, -2, 2... become 0, 1, 2, 3, 4...) and written as a varint:
+ *  7 bits per byte, least significant first, bit 7 set when another byte
+ *  follows. A difference of 0 is followed by a varint giving the number of
+ *  further taxels that did not change, so an idle sensor costs a few bytes.
+ *
+ * Sparse encoding:
+ *  Only the taxels that moved by more than a threshold since they were last
+ *  reported are written, as (index, value) pairs: index on one byte, value on
+ *  two bytes, little endian. The reported values are kept by the caller and
+ *  updated by the encoder.
+ *
+ * ========================================
+*/
+
+#ifndef TAXEL_CODEC_H
+#define TAXEL_CODEC_H
+
+#include <stdint.h>
+
+/*******************************************************************************
+* MACROS
+*******************************************************************************/
+// Maximum size of a varint written by the codec (17-bit zig-zag values)
+#define TAXEL_CODEC_VARINT_MAX_SIZE (3u)
+
+// Size of an (index, value) pair of the sparse encoding
+#define TAXEL_CODEC_PAIR_SIZE       (3u)
+
+// Returned by the encoders when the result doesn't fit in the output buffer
+#define TAXEL_CODEC_NO_FIT          (0xFFFFu)
+
+/*******************************************************************************
+* PUBLIC PROTOTYPES
+*******************************************************************************/
+uint16_t taxel_codec_delta(const uint16_t *previous, const uint8_t *taxels,
+                           uint8_t nbTaxels, uint8_t *out, uint16_t maxSize);
+uint16_t taxel_codec_sparse(uint16_t *reported, const uint8_t *taxels,
+                            uint8_t nbTaxels, uint16_t threshold,
+                            uint8_t *out, uint16_t maxSize);
+void taxel_codec_store(uint16_t *previous, const uint8_t *taxels, uint8_t nbTaxels);
+
+#endif // TAXEL_CODEC_H
+/* [] END OF FILE */
@@ -0,0 +1,39 @@
+/* ========================================
+ *
+ * Copyright YOUR COMPANY, THE YEAR
+ * All Rights Reserved
+ * UNPUBLISHED, LICENSED SOFTWARE.
+ *
+ * CONFIDENTIAL AND PROPRIETARY INFORMATION
+ * WHICH IS THE PROPERTY OF your company.
+ *
+ * ========================================
+ *
+ * Summary:
+ *  Where the sensors of CapSense_dsRam go in sensorsList, in runs of
+ *  consecutive taxels (see Common/taxel_map.h). Included by main.h, after
+ *  project.h and taxel_map.h, and by host/taxel_map_test.c.
+ *
+ * ========================================
+*/
+
+#ifndef TAXEL_MAP_TABLE_H
+#define TAXEL_MAP_TABLE_H
+
+const TaxelMapRun taxelMap[] =
+{
+    TAXEL_MAP_RUN(CapSense_dsRam.snsList.row0,    4,   0),
+    TAXEL_MAP_RUN(CapSense_dsRam.snsList.row1,    5,   4),
+    TAXEL_MAP_RUN(CapSense_dsRam.snsList.row2,    5,   9),
+    TAXEL_MAP_RUN(CapSense_dsRam.snsList.row3,    5,  14),
+    TAXEL_MAP_RUN(CapSense_dsRam.snsList.row4,    7,  19),
+    TAXEL_MAP_RUN(CapSense_dsRam.snsList.row5,    7,  26),
+    TAXEL_MAP_RUN(CapSense_dsRam.snsList.row6,    4,  33),
+    TAXEL_MAP_RUN(CapSense_dsRam.snsList.row7,    4,  37),
+    TAXEL_MAP_RUN(CapSense_dsRam.snsList.row8,    2,  41),
+    TAXEL_MAP_RUN(CapSense_dsRam.snsList.row9,    2,  43),
+    TAXEL_MAP_RUN(CapSense_dsRam.snsList.row10,   2,  45)
+};
+
+#endif // TAXEL_MAP_TABLE_H
+/* [] END OF FILE */
@@ -0,0 +1,35 @@
+/* ========================================
+ *
+ * Copyright YOUR COMPANY, THE YEAR
+ * All Rights Reserved
+ * UNPUBLISHED, LICENSED SOFTWARE.
+ *
+ * CONFIDENTIAL AND PROPRIETARY INFORMATION
+ * WHICH IS THE PROPERTY OF your company.
+ *
+ * ========================================
+ *
+ * Summary:
+ *  Where the sensors of CapSense_dsRam go in sensorsList, in runs of
+ *  consecutive taxels (see Common/taxel_map.h). Included by main.h, after
+ *  project.h and taxel_map.h, and by host/taxel_map_test.c.
+ *
+ * ========================================
+*/
+
+#ifndef TAXEL_MAP_TABLE_H
+#define TAXEL_MAP_TABLE_H
+
+const TaxelMapRun taxelMap[] =
+{
+    TAXEL_MAP_RUN(CapSense_dsRam.snsList.row0,   6,   0),
+    TAXEL_MAP_RUN(CapSense_dsRam.snsList.row1,   7,   6),
+    TAXEL_MAP_RUN(CapSense_dsRam.snsList.row2,   7,  13),
+    TAXEL_MAP_RUN(CapSense_dsRam.snsList.row3,   3,  20),
+    TAXEL_MAP_RUN(CapSense_dsRam.snsList.row4,   3,  23),
+    TAXEL_MAP_RUN(CapSense_dsRam.snsList.row5,   3,  26),
+    TAXEL_MAP_RUN(CapSense_dsRam.snsList.row6,   2,  29)
+};
+
+#endif // TAXEL_MAP_TABLE_H
+/* [] END OF FILE */
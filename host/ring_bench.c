@@ -0,0 +1,133 @@
+/*******************************************************************************
+*
+* Host micro-benchmark of the FIFO buffers of comm_driver (SensorHub_V3):
+* spsc_ring (static, power-of-two, lock-free) against ringbuf (heap, modulus),
+* ringbuf_memcpy_into/ringbuf_memcpy_from against spsc_ring_write/
+* spsc_ring_read.
+*
+* Each case streams the same bytes through both rings in chunks the driver
+* uses: 1 byte (UART RX interrupt), 8 bytes (SCB FIFO), 23 bytes (a status
+* message), 64 bytes (USBUART packet) and 255 bytes (largest message). The
+* ring is kept partly full so the copies wrap. The bytes read back are
+* checked.
+*
+* The host has a hardware divider and a fast memcpy; on the Cortex-M0 of the
+* hub the gap is wider. It doesn't measure the critical sections that the
+* ringbuf version needed in the driver.
+*
+* Build (C99):
+*  gcc -std=gnu99 -O2 -I../BICI_Psoc_workspace/SensorHub_V3.cydsn ring_bench.c
+*      ../BICI_Psoc_workspace/SensorHub_V3.cydsn/ringbuf.c
+*      ../BICI_Psoc_workspace/SensorHub_V3.cydsn/spsc_ring.c -o ring_bench
+*
+*******************************************************************************/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "ringbuf.h"
+#include "spsc_ring.h"
+
+// comm_driver.h: RX_BUFFER_SIZE and TX_BUFFER_SIZE, before and now
+#define RINGBUF_CAPACITY    (300u)
+#define SPSC_RING_SIZE      (256u)
+
+// Bytes kept in the rings, so the copies wrap (less for the big chunks)
+#define PREFILL             (100u)
+#define PREFILL_FOR(chunk)  ((chunk) + PREFILL > SPSC_RING_SIZE ? \
+                             SPSC_RING_SIZE - (chunk) : PREFILL)
+
+#define TOTAL_BYTES         (64u * 1024u * 1024u)
+#define PATTERN_SIZE        (4096u)
+
+SPSC_RING_DEFINE(spscRing, SPSC_RING_SIZE);
+
+static uint8_t pattern[PATTERN_SIZE + 256u];
+
+static double nowNs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Stream TOTAL_BYTES through a ringbuf, 'chunk' bytes at a time.
+// Returns ns per byte, or a negative value if the bytes came back wrong.
+static double benchRingbuf(size_t chunk)
+{
+    ringbuf_t rb = ringbuf_new(RINGBUF_CAPACITY);
+    uint8_t out[256];
+    size_t in = 0, check = 0;
+
+    ringbuf_memcpy_into(rb, pattern, PREFILL_FOR(chunk));
+    in = PREFILL_FOR(chunk);
+
+    double start = nowNs();
+    for(size_t done = 0; done < TOTAL_BYTES; done += chunk) {
+        ringbuf_memcpy_into(rb, pattern + in % PATTERN_SIZE, chunk);
+        in += chunk;
+        ringbuf_memcpy_from(out, rb, chunk);
+        if(memcmp(out, pattern + check % PATTERN_SIZE, chunk) != 0) {
+            ringbuf_free(&rb);
+            return -1.0;
+        }
+        check += chunk;
+    }
+    double elapsed = nowNs() - start;
+
+    ringbuf_free(&rb);
+    return elapsed / TOTAL_BYTES;
+}
+
+// Same as benchRingbuf() with the spsc_ring
+static double benchSpscRing(size_t chunk)
+{
+    uint8_t out[256];
+    size_t in = 0, check = 0;
+
+    spsc_ring_flush(&spscRing);
+    spsc_ring_write(&spscRing, pattern, PREFILL_FOR(chunk));
+    in = PREFILL_FOR(chunk);
+
+    double start = nowNs();
+    for(size_t done = 0; done < TOTAL_BYTES; done += chunk) {
+        spsc_ring_write(&spscRing, pattern + in % PATTERN_SIZE, chunk);
+        in += chunk;
+        spsc_ring_read(&spscRing, out, chunk);
+        if(memcmp(out, pattern + check % PATTERN_SIZE, chunk) != 0)
+            return -1.0;
+        check += chunk;
+    }
+    double elapsed = nowNs() - start;
+
+    return elapsed / TOTAL_BYTES;
+}
+
+int main(void)
+{
+    // The pattern repeats every PATTERN_SIZE bytes, so chunks can be taken at
+    // any offset without wrapping
+    for(size_t i = 0; i < sizeof(pattern); i++)
+        pattern[i] = (uint8_t)(i % PATTERN_SIZE * 131u + 7u);
+
+    static const size_t chunks[] = {1, 8, 23, 64, 255};
+    int failed = 0;
+
+    printf("chunk  ringbuf ns/B  spsc_ring ns/B  speedup\n");
+    for(size_t i = 0; i < sizeof(chunks) / sizeof(chunks[0]); i++) {
+        double ringbuf = benchRingbuf(chunks[i]);
+        double spsc = benchSpscRing(chunks[i]);
+        if(ringbuf < 0.0 || spsc < 0.0) {
+            printf("%5zu  data mismatch\n", chunks[i]);
+            failed = 1;
+            continue;
+        }
+        printf("%5zu  %12.3f  %14.3f  %6.2fx\n", chunks[i], ringbuf, spsc,
+               ringbuf / spsc);
+    }
+
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,210 @@
+/*******************************************************************************
+*
+* Host round-trip test of the taxel encodings: frames encoded with
+* taxel_codec.c (SensorHub_V3), the way sendEncodedDataToUART() of the hub
+* does, and decoded with TaxelDecoder (taxel_decoder.h).
+*
+* Cases: key frame, delta frame (small, negative and large differences),
+* zero runs (idle sensor, unchanged taxels at the end), sparse frame against
+* the reported values, counter gap (deltas dropped until the next key frame)
+* and a raw frame, which is not a reference for the deltas.
+*
+* Returns 0 when every case passes.
+*
+* Build (C99 and C++11):
+*  gcc -std=gnu99 -O2 -c ../BICI_Psoc_workspace/SensorHub_V3.cydsn/taxel_codec.c
+*  g++ -std=c++11 -O2 -I../BICI_Psoc_workspace/SensorHub_V3.cydsn
+*      taxel_codec_test.cpp taxel_decoder.cpp taxel_codec.o -o taxel_codec_test
+*
+*******************************************************************************/
+
+#include <cstdio>
+#include <vector>
+
+#include "taxel_decoder.h"
+
+extern "C" {
+#include "taxel_codec.h"
+}
+
+namespace {
+
+// SensorHub_V3 main.h
+const uint8_t ENCODED_TAG_FLAG = 0x80;
+const uint8_t ENCODING_KEY = 0x01;
+const uint8_t ENCODING_DELTA = 0x02;
+const uint8_t ENCODING_SPARSE = 0x03;
+
+const uint8_t ADDRESS = 0x0B;
+const uint8_t NB_TAXELS = 66;
+const uint16_t MAX_ENCODED_SIZE = 2 * NB_TAXELS;
+const uint16_t THRESHOLD = 20;
+
+// Hub side of one sensor: its history and frame counter
+struct Encoder
+{
+    std::vector<uint16_t> history = std::vector<uint16_t>(NB_TAXELS);
+    uint8_t counter = 0;
+    uint32_t time = 0;
+};
+
+std::vector<uint8_t> littleEndian(const std::vector<uint16_t> &taxels)
+{
+    std::vector<uint8_t> bytes;
+    for (uint16_t taxel : taxels) {
+        bytes.push_back(static_cast<uint8_t>(taxel & 0xFF));
+        bytes.push_back(static_cast<uint8_t>(taxel >> 8));
+    }
+    return bytes;
+}
+
+// Encoded message: tag, encoding, counter, time, payload
+std::vector<uint8_t> message(Encoder &encoder, uint8_t encoding,
+                             const std::vector<uint8_t> &payload)
+{
+    std::vector<uint8_t> msg = {static_cast<uint8_t>(ENCODED_TAG_FLAG | ADDRESS),
+                                encoding, encoder.counter++};
+    encoder.time += 1000;
+    for (int i = 0; i < 4; ++i)
+        msg.push_back(static_cast<uint8_t>(encoder.time >> (8 * i)));
+    msg.insert(msg.end(), payload.begin(), payload.end());
+    return msg;
+}
+
+std::vector<uint8_t> keyFrame(Encoder &encoder, const std::vector<uint16_t> &taxels)
+{
+    std::vector<uint8_t> bytes = littleEndian(taxels);
+    taxel_codec_store(encoder.history.data(), bytes.data(), NB_TAXELS);
+    return message(encoder, ENCODING_KEY, bytes);
+}
+
+std::vector<uint8_t> deltaFrame(Encoder &encoder, const std::vector<uint16_t> &taxels)
+{
+    std::vector<uint8_t> bytes = littleEndian(taxels);
+    std::vector<uint8_t> out(MAX_ENCODED_SIZE);
+    uint16_t size = taxel_codec_delta(encoder.history.data(), bytes.data(),
+                                      NB_TAXELS, out.data(), MAX_ENCODED_SIZE);
+    if (size == TAXEL_CODEC_NO_FIT)
+        return std::vector<uint8_t>();
+    out.resize(size);
+    taxel_codec_store(encoder.history.data(), bytes.data(), NB_TAXELS);
+    return message(encoder, ENCODING_DELTA, out);
+}
+
+// The history holds the reported values, updated by the encoder
+std::vector<uint8_t> sparseFrame(Encoder &encoder, const std::vector<uint16_t> &taxels)
+{
+    std::vector<uint8_t> bytes = littleEndian(taxels);
+    std::vector<uint8_t> out(MAX_ENCODED_SIZE);
+    uint16_t size = taxel_codec_sparse(encoder.history.data(), bytes.data(),
+                                       NB_TAXELS, THRESHOLD, out.data(),
+                                       MAX_ENCODED_SIZE);
+    if (size == TAXEL_CODEC_NO_FIT)
+        return std::vector<uint8_t>();
+    out.resize(size);
+    return message(encoder, ENCODING_SPARSE, out);
+}
+
+std::vector<uint8_t> rawFrame(const std::vector<uint16_t> &taxels)
+{
+    std::vector<uint8_t> msg = {ADDRESS, 0, 0, 0, 0};
+    std::vector<uint8_t> bytes = littleEndian(taxels);
+    msg.insert(msg.end(), bytes.begin(), bytes.end());
+    return msg;
+}
+
+int failures = 0;
+
+void check(const char *name, bool ok)
+{
+    std::printf("%-40s %s\n", name, ok ? "ok" : "FAIL");
+    if (!ok)
+        ++failures;
+}
+
+// Decode a message and compare the frame with the expected taxels
+bool decodes(bici::TaxelDecoder &decoder, const std::vector<uint8_t> &msg,
+             const std::vector<uint16_t> &expected)
+{
+    std::vector<bici::SensorFrame> frames;
+    if (msg.empty() ||
+        decoder.decode(msg.data(), msg.size(), frames) != bici::DecodeStatus::Ok)
+        return false;
+    return frames.size() == 1 && frames[0].address == ADDRESS &&
+           frames[0].taxels == expected;
+}
+
+bici::DecodeStatus status(bici::TaxelDecoder &decoder, const std::vector<uint8_t> &msg)
+{
+    std::vector<bici::SensorFrame> frames;
+    return decoder.decode(msg.data(), msg.size(), frames);
+}
+
+} // namespace
+
+int main()
+{
+    bici::TaxelDecoder decoder;
+    Encoder encoder;
+    std::vector<uint16_t> taxels(NB_TAXELS);
+
+    for (size_t i = 0; i < taxels.size(); ++i)
+        taxels[i] = static_cast<uint16_t>(1000 + 37 * i);
+    check("key frame", decodes(decoder, keyFrame(encoder, taxels), taxels));
+
+    // Small, negative and large (3-byte varint) differences
+    taxels[0] += 1;
+    taxels[1] -= 1;
+    taxels[2] += 60;
+    taxels[3] -= 200;
+    taxels[4] += 30000;
+    taxels[NB_TAXELS - 1] = 0;
+    check("delta frame", decodes(decoder, deltaFrame(encoder, taxels), taxels));
+
+    // Nothing moved: a zero and the run of the other taxels, after the
+    // header and the time
+    std::vector<uint8_t> idle = deltaFrame(encoder, taxels);
+    check("delta frame, idle sensor", decodes(decoder, idle, taxels) &&
+          idle.size() == 3 + 4 + 2);
+
+    // Unchanged taxels in the middle and at the end
+    taxels[10] += 5;
+    taxels[40] -= 5;
+    check("delta frame, zero runs", decodes(decoder, deltaFrame(encoder, taxels), taxels));
+
+    // Sparse: only the taxels past the threshold are reported, the decoder
+    // keeps the last reported value of the others
+    std::vector<uint16_t> sparse = taxels;
+    sparse[5] += THRESHOLD + 1;
+    sparse[6] += THRESHOLD;
+    sparse[50] -= 500;
+    std::vector<uint16_t> reported = taxels;
+    reported[5] = sparse[5];
+    reported[50] = sparse[50];
+    check("sparse frame", decodes(decoder, sparseFrame(encoder, sparse), reported));
+    check("sparse frame, nothing moved",
+          decodes(decoder, sparseFrame(encoder, sparse), reported));
+
+    // A lost frame: the deltas are dropped until the next key frame
+    taxels = reported;
+    taxels[7] += 3;
+    deltaFrame(encoder, taxels);
+    taxels[8] += 3;
+    check("counter gap, delta dropped",
+          status(decoder, deltaFrame(encoder, taxels)) == bici::DecodeStatus::NeedKeyFrame);
+    taxels[9] += 3;
+    check("counter gap, next delta dropped",
+          status(decoder, deltaFrame(encoder, taxels)) == bici::DecodeStatus::NeedKeyFrame);
+    check("counter gap, key frame", decodes(decoder, keyFrame(encoder, taxels), taxels));
+    taxels[11] += 3;
+    check("counter gap, delta after the key frame",
+          decodes(decoder, deltaFrame(encoder, taxels), taxels));
+
+    // A raw frame is not a reference for the deltas
+    check("raw frame", decodes(decoder, rawFrame(taxels), taxels));
+    taxels[12] += 3;
+    check("raw frame, delta dropped",
+          status(decoder, deltaFrame(encoder, taxels)) == bici::DecodeStatus::NeedKeyFrame);
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,364 @@
+/*******************************************************************************
+*
+* Host decoder for the messages sent by SensorHub_V3 on its UART link.
+* See taxel_decoder.h.
+*
+*******************************************************************************/
+
+#include "taxel_decoder.h"
+
+namespace bici {
+
+namespace {
+
+// comm_driver_msg.h
+const uint8_t MSG_FIRST_BYTE = 0x01;
+const uint8_t MSG_LONG_FIRST_BYTE = 0x02;
+const uint8_t MSG_LAST_BYTE = '\n';
+const size_t MSG_HEADER_LENGTH = 2;
+const size_t MSG_LONG_HEADER_LENGTH = 3;
+const size_t MSG_FOOTER_LENGTH = 1;
+
+// SensorHub_V3 main.h
+const uint8_t HUB_MSG_TAG = 0x00;
+const uint8_t HUB_MSG_HAND_FRAME = 0x01;
+const size_t HAND_FRAME_HEADER_SIZE = 8;
+const size_t HAND_FRAME_FOOTER_SIZE = 4;
+const uint8_t HUB_MSG_SENSOR_LIST = 0x06;
+const size_t SENSOR_LIST_HEADER_SIZE = 3;
+const size_t SENSOR_LIST_ENTRY_SIZE = 8;
+const uint8_t ENCODED_TAG_FLAG = 0x80;
+const uint8_t ENCODING_KEY = 0x01;
+const uint8_t ENCODING_DELTA = 0x02;
+const uint8_t ENCODING_SPARSE = 0x03;
+const size_t SPARSE_PAIR_SIZE = 3;
+const size_t ENCODED_HEADER_SIZE = 3;
+const size_t SENSOR_TAG_SIZE = 1;
+const size_t TIME_DATA_SIZE = 4;
+
+const uint8_t DEFAULT_ADDRESSES[] =
+    {0x17, 0x18, 0x19, 0x1A, 0x1B, 0x1C, 0x1D, 0x08, 0x09, 0x0A, 0x0B,
+     0x0C, 0x0D, 0x0E, 0x0F, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16};
+const uint16_t DEFAULT_NB_TAXELS[] =
+    {66, 27, 65, 30, 78, 66, 27, 65, 30, 78, 66,
+     27, 65, 30, 78, 66, 20, 20, 20, 20, 121, 118};
+
+uint16_t readU16(const uint8_t *p)
+{
+    return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+
+uint32_t readU32(const uint8_t *p)
+{
+    return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+           (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+void readTaxels(const uint8_t *p, size_t count, std::vector<uint16_t> &taxels)
+{
+    taxels.resize(count);
+    for (size_t i = 0; i < count; ++i)
+        taxels[i] = readU16(p + 2 * i);
+}
+
+// Read a varint (see taxel_codec.h), false if it runs past 'end'
+bool readVarint(const uint8_t *&p, const uint8_t *end, uint32_t &value)
+{
+    value = 0;
+    for (unsigned shift = 0; p < end && shift < 32; shift += 7) {
+        uint8_t byte = *p++;
+        value |= static_cast<uint32_t>(byte & 0x7F) << shift;
+        if (!(byte & 0x80))
+            return true;
+    }
+    return false;
+}
+
+int32_t unzigzag(uint32_t value)
+{
+    return static_cast<int32_t>(value >> 1) ^ -static_cast<int32_t>(value & 1);
+}
+
+} // namespace
+
+/*******************************************************************************
+* MessageDeframer
+*******************************************************************************/
+void MessageDeframer::push(const uint8_t *data, size_t count)
+{
+    // Drop the consumed bytes before growing the buffer
+    if (start_ > 0 && start_ >= buffer_.size() / 2) {
+        buffer_.erase(buffer_.begin(), buffer_.begin() + start_);
+        start_ = 0;
+    }
+    buffer_.insert(buffer_.end(), data, data + count);
+}
+
+bool MessageDeframer::next(std::vector<uint8_t> &msg)
+{
+    while (start_ < buffer_.size()) {
+        const uint8_t *p = buffer_.data() + start_;
+        size_t available = buffer_.size() - start_;
+        size_t headerLength;
+        size_t length;
+
+        if (p[0] == MSG_FIRST_BYTE) {
+            if (available < MSG_HEADER_LENGTH)
+                return false;
+            headerLength = MSG_HEADER_LENGTH;
+            length = p[1];
+        }
+        else if (p[0] == MSG_LONG_FIRST_BYTE) {
+            if (available < MSG_LONG_HEADER_LENGTH)
+                return false;
+            headerLength = MSG_LONG_HEADER_LENGTH;
+            length = readU16(p + 1);
+        }
+        else {
+            ++start_;
+            ++skipped_;
+            continue;
+        }
+
+        if (length < headerLength + MSG_FOOTER_LENGTH) {
+            ++start_;
+            ++skipped_;
+            continue;
+        }
+        if (available < length)
+            return false;
+        if (p[length - 1] != MSG_LAST_BYTE) {
+            ++start_;
+            ++skipped_;
+            continue;
+        }
+
+        msg.assign(p + headerLength, p + length - MSG_FOOTER_LENGTH);
+        start_ += length;
+        return true;
+    }
+    return false;
+}
+
+void MessageDeframer::reset()
+{
+    buffer_.clear();
+    start_ = 0;
+}
+
+/*******************************************************************************
+* TaxelDecoder
+*******************************************************************************/
+TaxelDecoder::TaxelDecoder()
+    : sensors_(defaultSensors())
+{
+}
+
+TaxelDecoder::TaxelDecoder(const std::vector<SensorInfo> &sensors)
+    : sensors_(sensors)
+{
+}
+
+std::vector<SensorInfo> TaxelDecoder::defaultSensors()
+{
+    std::vector<SensorInfo> sensors;
+    for (size_t i = 0; i < sizeof(DEFAULT_ADDRESSES); ++i)
+        sensors.push_back(SensorInfo{DEFAULT_ADDRESSES[i], DEFAULT_NB_TAXELS[i], 0, 0, 0, 0, 0});
+    return sensors;
+}
+
+DecodeStatus TaxelDecoder::decode(const uint8_t *msg, size_t size,
+                                  std::vector<SensorFrame> &frames)
+{
+    frames.clear();
+    if (size == 0)
+        return DecodeStatus::Malformed;
+
+    if (msg[0] == HUB_MSG_TAG)
+        return decodeHubMessage(msg, size, frames);
+    if (msg[0] & ENCODED_TAG_FLAG)
+        return decodeEncoded(msg, size, frames);
+    return decodeRaw(msg, size, frames);
+}
+
+DecodeStatus TaxelDecoder::decodeRaw(const uint8_t *msg, size_t size,
+                                     std::vector<SensorFrame> &frames)
+{
+    size_t header = SENSOR_TAG_SIZE + TIME_DATA_SIZE;
+    if (size < header || (size - header) % 2)
+        return DecodeStatus::Malformed;
+
+    SensorFrame frame;
+    frame.address = msg[0];
+    frame.time = readU32(msg + SENSOR_TAG_SIZE);
+    readTaxels(msg + header, (size - header) / 2, frame.taxels);
+
+    // Not a reference for the delta and sparse frames: the hub starts them
+    // after a key frame, and they are dropped until one arrives
+    SensorState &state = states_[frame.address];
+    state.taxels = frame.taxels;
+    state.valid = false;
+
+    frames.push_back(std::move(frame));
+    return DecodeStatus::Ok;
+}
+
+DecodeStatus TaxelDecoder::decodeEncoded(const uint8_t *msg, size_t size,
+                                         std::vector<SensorFrame> &frames)
+{
+    size_t header = ENCODED_HEADER_SIZE + TIME_DATA_SIZE;
+    if (size < header)
+        return DecodeStatus::Malformed;
+
+    uint8_t address = msg[0] & ~ENCODED_TAG_FLAG;
+    uint8_t encoding = msg[1];
+    uint8_t counter = msg[2];
+    const uint8_t *payload = msg + header;
+    const uint8_t *end = msg + size;
+    SensorState &state = states_[address];
+
+    SensorFrame frame;
+    frame.address = address;
+    frame.time = readU32(msg + ENCODED_HEADER_SIZE);
+
+    if (encoding == ENCODING_KEY) {
+        if ((size - header) % 2)
+            return DecodeStatus::Malformed;
+        readTaxels(payload, (size - header) / 2, frame.taxels);
+    }
+    else if (encoding == ENCODING_DELTA || encoding == ENCODING_SPARSE) {
+        // Only apply on top of the previous frame of the sensor
+        if (!state.valid || counter != static_cast<uint8_t>(state.counter + 1)) {
+            state.valid = false;
+            return DecodeStatus::NeedKeyFrame;
+        }
+        frame.taxels = state.taxels;
+    }
+
+    if (encoding == ENCODING_SPARSE) {
+        if ((size - header) % SPARSE_PAIR_SIZE) {
+            state.valid = false;
+            return DecodeStatus::Malformed;
+        }
+        for (; payload < end; payload += SPARSE_PAIR_SIZE) {
+            if (payload[0] >= frame.taxels.size()) {
+                state.valid = false;
+                return DecodeStatus::Malformed;
+            }
+            frame.taxels[payload[0]] = readU16(payload + 1);
+        }
+    }
+    else if (encoding == ENCODING_DELTA) {
+        size_t i = 0;
+        while (i < frame.taxels.size()) {
+            uint32_t value;
+            if (!readVarint(payload, end, value)) {
+                state.valid = false;
+                return DecodeStatus::Malformed;
+            }
+            int32_t delta = unzigzag(value);
+            frame.taxels[i] = static_cast<uint16_t>(frame.taxels[i] + delta);
+            ++i;
+
+            // A zero is followed by the number of further unchanged taxels
+            if (delta == 0) {
+                uint32_t run;
+                if (!readVarint(payload, end, run) || run > frame.taxels.size() - i) {
+                    state.valid = false;
+                    return DecodeStatus::Malformed;
+                }
+                i += run;
+            }
+        }
+        if (payload != end) {
+            state.valid = false;
+            return DecodeStatus::Malformed;
+        }
+    }
+    else if (encoding != ENCODING_KEY) {
+        return DecodeStatus::Ignored;
+    }
+
+    state.taxels = frame.taxels;
+    state.counter = counter;
+    state.valid = true;
+
+    frames.push_back(std::move(frame));
+    return DecodeStatus::Ok;
+}
+
+DecodeStatus TaxelDecoder::decodeHubMessage(const uint8_t *msg, size_t size,
+                                            std::vector<SensorFrame> &frames)
+{
+    if (size >= 2 && msg[1] == HUB_MSG_SENSOR_LIST)
+        return decodeSensorList(msg, size);
+    if (size < 2 || msg[1] != HUB_MSG_HAND_FRAME)
+        return DecodeStatus::Ignored;
+    if (size < HAND_FRAME_HEADER_SIZE + HAND_FRAME_FOOTER_SIZE)
+        return DecodeStatus::Malformed;
+
+    uint16_t sequence = readU16(msg + 2);
+    uint32_t present = readU32(msg + 4);
+    const uint8_t *p = msg + HAND_FRAME_HEADER_SIZE;
+    const uint8_t *end = msg + size - HAND_FRAME_FOOTER_SIZE;
+
+    for (size_t i = 0; i < sensors_.size() && i < 32; ++i) {
+        if (!(present & (1ul << i)))
+            continue;
+
+        size_t entrySize = TIME_DATA_SIZE + 2 * sensors_[i].nbTaxels;
+        if (static_cast<size_t>(end - p) < entrySize) {
+            frames.clear();
+            return DecodeStatus::Malformed;
+        }
+
+        SensorFrame frame;
+        frame.address = sensors_[i].address;
+        frame.time = readU32(p);
+        readTaxels(p + TIME_DATA_SIZE, sensors_[i].nbTaxels, frame.taxels);
+        frames.push_back(std::move(frame));
+        p += entrySize;
+    }
+    if (p != end) {
+        frames.clear();
+        return DecodeStatus::Malformed;
+    }
+
+    // Failed entries were sent as zeros, don't return them
+    handFailed_ = readU32(end);
+    size_t kept = 0;
+    for (size_t i = 0, f = 0; i < sensors_.size() && i < 32; ++i) {
+        if (!(present & (1ul << i)))
+            continue;
+        if (!(handFailed_ & (1ul << i)))
+            frames[kept++] = std::move(frames[f]);
+        ++f;
+    }
+    frames.resize(kept);
+
+    if (handSequenceValid_)
+        lostHandFrames_ += static_cast<uint16_t>(sequence - handSequence_ - 1);
+    handSequence_ = sequence;
+    handSequenceValid_ = true;
+
+    return DecodeStatus::Ok;
+}
+
+DecodeStatus TaxelDecoder::decodeSensorList(const uint8_t *msg, size_t size)
+{
+    if (size < SENSOR_LIST_HEADER_SIZE ||
+        size != SENSOR_LIST_HEADER_SIZE + SENSOR_LIST_ENTRY_SIZE * msg[2])
+        return DecodeStatus::Malformed;
+
+    std::vector<SensorInfo> sensors;
+    for (const uint8_t *p = msg + SENSOR_LIST_HEADER_SIZE; p < msg + size;
+         p += SENSOR_LIST_ENTRY_SIZE)
+        sensors.push_back(SensorInfo{p[0], readU16(p + 2), p[1], p[4], p[5], p[6], p[7]});
+
+    // A new enumeration may have moved the sensors in the bitmaps
+    sensors_ = sensors;
+    handSequenceValid_ = false;
+    return DecodeStatus::Ignored;
+}
+
+} // namespace bici
@@ -0,0 +1,146 @@
+/*******************************************************************************
+*
+* Host decoder for the messages sent by SensorHub_V3 on its UART link.
+*
+* MessageDeframer cuts the byte stream into messages (see comm_driver_msg.h),
+* and TaxelDecoder turns each message into sensor frames:
+*  - raw sensor messages (sensor address + time + taxels),
+*  - encoded sensor messages (key, delta and sparse frames, see main.h and
+*    taxel_codec.h of the hub),
+*  - hand frames (STREAM_HAND_FRAME mode).
+* The sensors of the hand frames are the ones of the last sensor list sent by
+* the hub after its bus enumeration.
+*
+* Build (C++11):
+*  g++ -std=c++11 -O2 -c taxel_decoder.cpp
+*
+* Usage:
+*  bici::MessageDeframer deframer;
+*  bici::TaxelDecoder decoder;
+*  std::vector<uint8_t> msg;
+*  std::vector<bici::SensorFrame> frames;
+*
+*  deframer.push(bytes, count);
+*  while (deframer.next(msg))
+*      if (decoder.decode(msg.data(), msg.size(), frames) == bici::DecodeStatus::Ok)
+*          for (const bici::SensorFrame &frame : frames)
+*              ...
+*
+*******************************************************************************/
+
+#ifndef BICI_TAXEL_DECODER_H
+#define BICI_TAXEL_DECODER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <vector>
+
+namespace bici {
+
+// Taxels of one sensor at one instant. For sparse frames, the taxels that
+// were not reported keep their last reported value.
+struct SensorFrame
+{
+    uint8_t address;                // I2C address of the sensor
+    uint32_t time;                  // Sensor timer when the scan was published
+    std::vector<uint16_t> taxels;
+};
+
+// A sensor known by the hub, in the order of its sensorList
+struct SensorInfo
+{
+    uint8_t address;
+    uint16_t nbTaxels;
+    uint8_t type;               // SENSOR_TYPE_xxx of the node descriptor
+    uint8_t firmwareVersion;
+    uint8_t bus;                // I2C bus of the hub the sensor is on
+    uint8_t capabilities;       // NODE_CAP_xxx of the node descriptor
+    uint8_t speed;              // I2C speed the hub reads it at (I2C_SPEED_xxx
+                                // of the hub), 0: Fast-mode, 400 kHz SCL,
+                                // 1: Fast-mode Plus, 1 MHz SCL
+};
+
+enum class DecodeStatus
+{
+    Ok,             // 'frames' holds the decoded frames
+    NeedKeyFrame,   // Delta or sparse frame without a valid reference, dropped
+    Malformed,      // Message too short or inconsistent
+    Ignored         // Message that holds no taxels (a sensor list is still
+                    // applied)
+};
+
+/*******************************************************************************
+* Cut the UART byte stream into messages, without their header and footer.
+* Bytes that don't belong to a valid message are skipped.
+*******************************************************************************/
+class MessageDeframer
+{
+public:
+    void push(const uint8_t *data, size_t count);
+    bool next(std::vector<uint8_t> &msg);
+    void reset();
+
+    // Bytes skipped while looking for a valid message
+    uint64_t skippedBytes() const { return skipped_; }
+
+private:
+    std::vector<uint8_t> buffer_;
+    size_t start_ = 0;
+    uint64_t skipped_ = 0;
+};
+
+/*******************************************************************************
+* Decode the messages of the hub. Keeps the last frame of each sensor, which
+* is the reference of the delta frames.
+*******************************************************************************/
+class TaxelDecoder
+{
+public:
+    TaxelDecoder();
+    explicit TaxelDecoder(const std::vector<SensorInfo> &sensors);
+
+    DecodeStatus decode(const uint8_t *msg, size_t size,
+                        std::vector<SensorFrame> &frames);
+
+    // Sequence number of the last hand frame, and the number of hand frames
+    // missing between the received ones
+    uint16_t lastHandFrameSequence() const { return handSequence_; }
+    uint64_t lostHandFrames() const { return lostHandFrames_; }
+
+    // Present sensors of the last hand frame whose packet could not be read
+    uint32_t lastHandFrameFailed() const { return handFailed_; }
+
+    // Sensors of the hand frames, in sensorList order of the hub
+    const std::vector<SensorInfo> &sensors() const { return sensors_; }
+
+    // Sensors of the full hand, used until the hub sends its sensor list
+    static std::vector<SensorInfo> defaultSensors();
+
+private:
+    struct SensorState
+    {
+        std::vector<uint16_t> taxels;
+        uint8_t counter = 0;
+        bool valid = false;
+    };
+
+    DecodeStatus decodeRaw(const uint8_t *msg, size_t size,
+                           std::vector<SensorFrame> &frames);
+    DecodeStatus decodeEncoded(const uint8_t *msg, size_t size,
+                               std::vector<SensorFrame> &frames);
+    DecodeStatus decodeHubMessage(const uint8_t *msg, size_t size,
+                                  std::vector<SensorFrame> &frames);
+    DecodeStatus decodeSensorList(const uint8_t *msg, size_t size);
+
+    std::vector<SensorInfo> sensors_;
+    std::map<uint8_t, SensorState> states_;
+    uint16_t handSequence_ = 0;
+    bool handSequenceValid_ = false;
+    uint64_t lostHandFrames_ = 0;
+    uint32_t handFailed_ = 0;
+};
+
+} // namespace bici
+
+#endif // BICI_TAXEL_DECODER_H
@@ -0,0 +1,432 @@
+/*******************************************************************************
+*
+* Host test of taxel_map_copy() (Common/taxel_map.c): the taxelMap[] table of
+* every sensor node (main.h) against the copy loops the nodes had before
+* (copyScanToSnapshot() in main.c).
+*
+* CapSense_dsRam is a fake with every widget the nodes use, each at least as
+* long as its longest run. The sensors hold more than the raw count, like
+* the generated CapSense_RAM_SNS_STRUCT, so the stride of the runs is
+* checked too. Each raw count is different, and the taxels start from the
+* same filler, so a taxel copied from the wrong sensor, or written where the
+* loops left it untouched, shows up.
+*
+* The tables are the ones the nodes build (taxel_map_table.h of each node),
+* renamed through a macro. The loops are the ones the nodes had when they
+* moved to the tables. Returns 0 when every node matches.
+*
+* Build (C99):
+*  gcc -std=gnu99 -O2 -I../BICI_Psoc_workspace/Common taxel_map_test.c
+*      ../BICI_Psoc_workspace/Common/taxel_map.c -o taxel_map_test
+*
+*******************************************************************************/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "taxel_map.h"
+
+typedef uint16_t uint16;
+
+// Fake of the CapSense data structure (CapSense_Structure.h)
+typedef struct
+{
+    uint16 raw[1];
+    uint16 bsln[1];
+    uint16 diff;
+} CapSense_RAM_SNS_STRUCT;
+
+typedef struct
+{
+    CapSense_RAM_SNS_STRUCT row0[11];
+    CapSense_RAM_SNS_STRUCT row1[11];
+    CapSense_RAM_SNS_STRUCT row2[11];
+    CapSense_RAM_SNS_STRUCT row3[11];
+    CapSense_RAM_SNS_STRUCT row4[11];
+    CapSense_RAM_SNS_STRUCT row5[11];
+    CapSense_RAM_SNS_STRUCT row6[11];
+    CapSense_RAM_SNS_STRUCT row7[11];
+    CapSense_RAM_SNS_STRUCT row8[11];
+    CapSense_RAM_SNS_STRUCT row9[11];
+    CapSense_RAM_SNS_STRUCT row10[11];
+    CapSense_RAM_SNS_STRUCT row11[11];
+    CapSense_RAM_SNS_STRUCT row12[11];
+    CapSense_RAM_SNS_STRUCT touchpad0[66];
+    CapSense_RAM_SNS_STRUCT touchpad1[42];
+    CapSense_RAM_SNS_STRUCT matrixbuttons0[4];
+    CapSense_RAM_SNS_STRUCT matrixbuttons1[4];
+    CapSense_RAM_SNS_STRUCT button0[5];
+} CapSense_RAM_SNS_LIST_STRUCT;
+
+typedef struct
+{
+    uint16 configId;
+    CapSense_RAM_SNS_LIST_STRUCT snsList;
+} CapSense_RAM_STRUCT;
+
+static CapSense_RAM_STRUCT CapSense_dsRam;
+
+// Taxels of the largest node (Palm_V3)
+#define MAX_TAXELS          (121u)
+#define TAXEL_FILLER        (0xA5A5u)
+
+// BOH_V3: 118 taxels
+static void copy_BOH_V3(uint16 *taxels)
+{
+    for(unsigned int i=0; i<11; ++i)
+    {
+        taxels[i]     = CapSense_dsRam.snsList.row0[i].raw[0];
+        taxels[i+12]  = CapSense_dsRam.snsList.row1[i].raw[0];
+        taxels[i+24]  = CapSense_dsRam.snsList.row2[i].raw[0];
+        taxels[i+36]  = CapSense_dsRam.snsList.row3[i].raw[0];
+        taxels[i+48]  = CapSense_dsRam.snsList.row4[i].raw[0];
+        taxels[i+60]  = CapSense_dsRam.snsList.row5[i].raw[0];
+        taxels[i+72]  = CapSense_dsRam.snsList.row6[i].raw[0];
+        taxels[i+84]  = CapSense_dsRam.snsList.row7[i].raw[0];
+        taxels[i+96]  = CapSense_dsRam.snsList.row8[i].raw[0];
+    }
+    for(unsigned int i=0; i<6; ++i) // Row9
+    {
+        taxels[i+108] = CapSense_dsRam.snsList.row9[i].raw[0];
+    }
+    for(unsigned int i=0; i<4; ++i) // Row10
+    {
+        taxels[i+114] = CapSense_dsRam.snsList.row10[i].raw[0];
+    }
+}
+
+#define taxelMap map_BOH_V3
+#include "../BICI_Psoc_workspace/BOH_V3.cydsn/taxel_map_table.h"
+#undef taxelMap
+#undef TAXEL_MAP_TABLE_H
+
+// Fingertip_V3_acc: 66 taxels
+static void copy_Fingertip_V3_acc(uint16 *taxels)
+{
+    for(unsigned int i=0; i<9; ++i) // Rows0-1
+    {
+        taxels[i] = CapSense_dsRam.snsList.row0[i].raw[0];
+        taxels[i+9] = CapSense_dsRam.snsList.row1[i].raw[0];
+    }
+    for(unsigned int i=0; i<7; ++i) // Row2
+    {
+        taxels[i+18] = CapSense_dsRam.snsList.row2[i].raw[0];
+    }
+    for(unsigned int i=0; i<5; ++i) // Row3
+    {
+        taxels[i+25] = CapSense_dsRam.snsList.row3[i].raw[0];
+    }
+    for(unsigned int i=0; i<4; ++i) // Rows4-12
+    {
+        taxels[i+30] = CapSense_dsRam.snsList.row4[i].raw[0];
+        taxels[i+34] = CapSense_dsRam.snsList.row5[i].raw[0];
+        taxels[i+38] = CapSense_dsRam.snsList.row6[i].raw[0];
+        taxels[i+42] = CapSense_dsRam.snsList.row7[i].raw[0];
+        taxels[i+46] = CapSense_dsRam.snsList.row8[i].raw[0];
+        taxels[i+50] = CapSense_dsRam.snsList.row9[i].raw[0];
+        taxels[i+54] = CapSense_dsRam.snsList.row10[i].raw[0];
+        taxels[i+58] = CapSense_dsRam.snsList.row11[i].raw[0];
+        taxels[i+62] = CapSense_dsRam.snsList.row12[i].raw[0];
+    }
+}
+
+#define taxelMap map_Fingertip_V3_acc
+#include "../BICI_Psoc_workspace/Fingertip_V3_acc.cydsn/taxel_map_table.h"
+#undef taxelMap
+#undef TAXEL_MAP_TABLE_H
+
+// MedialBack_V3: 30 taxels
+static void copy_MedialBack_V3(uint16 *taxels)
+{
+    for(unsigned int i=0; i<4; ++i) // Rows0-1
+    {
+        taxels[i] = CapSense_dsRam.snsList.row0[i].raw[0];
+        taxels[i+4] = CapSense_dsRam.snsList.row1[i].raw[0];
+    }
+    for(unsigned int i=0; i<6; ++i) // Row2
+    {
+        taxels[i+8] = CapSense_dsRam.snsList.row2[i].raw[0];
+    }
+    for(unsigned int i=0; i<3; ++i) // Row3-4
+    {
+        taxels[i+14] = CapSense_dsRam.snsList.row3[i].raw[0];
+        taxels[i+17] = CapSense_dsRam.snsList.row4[i].raw[0];
+    }
+    for(unsigned int i=0; i<5; ++i) // Row5
+    {
+        taxels[i+20] = CapSense_dsRam.snsList.row5[i].raw[0];
+    }
+    for(unsigned int i=0; i<4; ++i) // Row6
+    {
+        taxels[i+25] = CapSense_dsRam.snsList.row6[i].raw[0];
+    }
+    taxels[29] = CapSense_dsRam.snsList.row7[0].raw[0];
+}
+
+#define taxelMap map_MedialBack_V3
+#include "../BICI_Psoc_workspace/MedialBack_V3.cydsn/taxel_map_table.h"
+#undef taxelMap
+#undef TAXEL_MAP_TABLE_H
+
+// MedialFront_V3: 27 taxels
+static void copy_MedialFront_V3(uint16 *taxels)
+{
+    for(unsigned int i=0; i<4; ++i) // Rows0-2
+    {
+        taxels[i] = CapSense_dsRam.snsList.row0[i].raw[0];
+        taxels[i+4] = CapSense_dsRam.snsList.row1[i].raw[0];
+        taxels[i+8] = CapSense_dsRam.snsList.row2[i].raw[0];
+    }
+    for(unsigned int i=0; i<3; ++i) // Row3-7
+    {
+        taxels[i+12] = CapSense_dsRam.snsList.row3[i].raw[0];
+        taxels[i+15] = CapSense_dsRam.snsList.row4[i].raw[0];
+        taxels[i+18] = CapSense_dsRam.snsList.row5[i].raw[0];
+        taxels[i+21] = CapSense_dsRam.snsList.row6[i].raw[0];
+        taxels[i+24] = CapSense_dsRam.snsList.row7[i].raw[0];
+    }
+}
+
+#define taxelMap map_MedialFront_V3
+#include "../BICI_Psoc_workspace/MedialFront_V3.cydsn/taxel_map_table.h"
+#undef taxelMap
+#undef TAXEL_MAP_TABLE_H
+
+// Palm_V3: 121 taxels
+static void copy_Palm_V3(uint16 *taxels)
+{
+    for(unsigned int i=0; i<66; ++i) // Touchpad0
+    {
+        taxels[i] = CapSense_dsRam.snsList.touchpad0[i].raw[0];
+    }
+
+    for(unsigned int i=0; i<42; ++i) // Touchpad1
+    {
+        taxels[i+66] = CapSense_dsRam.snsList.touchpad1[i].raw[0];
+    }
+    for(unsigned int i=0; i<4; ++i) // MatrixButtons0
+    {
+        taxels[i+108] = CapSense_dsRam.snsList.matrixbuttons0[i].raw[0];
+    }
+    for(unsigned int i=0; i<4; ++i) // MatrixButtons1
+    {
+        taxels[i+112] = CapSense_dsRam.snsList.matrixbuttons1[i].raw[0];
+    }
+    for(unsigned int i=0; i<5; ++i) // Button0
+    {
+        taxels[i+116] = CapSense_dsRam.snsList.button0[i].raw[0];
+    }
+}
+
+#define taxelMap map_Palm_V3
+#include "../BICI_Psoc_workspace/Palm_V3.cydsn/taxel_map_table.h"
+#undef taxelMap
+#undef TAXEL_MAP_TABLE_H
+
+// ProximalBack_V3: 78 taxels
+static void copy_ProximalBack_V3(uint16 *taxels)
+{
+    for(unsigned int i=0; i<10; ++i) // Row
+    {
+        taxels[i] = CapSense_dsRam.snsList.row0[i].raw[0];
+    }
+
+    for(unsigned int i=0; i<9; ++i) // Row1-2
+    {
+        taxels[i+10] = CapSense_dsRam.snsList.row1[i].raw[0];
+        taxels[i+19] = CapSense_dsRam.snsList.row2[i].raw[0];
+    }
+    for(unsigned int i=0; i<11; ++i) // Row3-4
+    {
+        taxels[i+28] = CapSense_dsRam.snsList.row3[i].raw[0];
+        taxels[i+39] = CapSense_dsRam.snsList.row4[i].raw[0];
+    }
+    for(unsigned int i=0; i<6; ++i) // Row5-6
+    {
+        taxels[i+50] = CapSense_dsRam.snsList.row5[i].raw[0];
+        taxels[i+56] = CapSense_dsRam.snsList.row6[i].raw[0];
+    }
+    for(unsigned int i=0; i<4; ++i) // Row7-10
+    {
+        taxels[i+62] = CapSense_dsRam.snsList.row7[i].raw[0];
+        taxels[i+66] = CapSense_dsRam.snsList.row8[i].raw[0];
+        taxels[i+70] = CapSense_dsRam.snsList.row9[i].raw[0];
+        taxels[i+74] = CapSense_dsRam.snsList.row10[i].raw[0];
+    }
+}
+
+#define taxelMap map_ProximalBack_V3
+#include "../BICI_Psoc_workspace/ProximalBack_V3.cydsn/taxel_map_table.h"
+#undef taxelMap
+#undef TAXEL_MAP_TABLE_H
+
+// ProximalFront_V3: 65 taxels
+static void copy_ProximalFront_V3(uint16 *taxels)
+{
+
+    for(unsigned int i=0; i<11; ++i) // Rows0-2
+    {
+        taxels[i] = CapSense_dsRam.snsList.row0[i].raw[0];
+        taxels[i+11] = CapSense_dsRam.snsList.row1[i].raw[0];
+        taxels[i+22] = CapSense_dsRam.snsList.row2[i].raw[0];
+    }
+    for(unsigned int i=0; i<6; ++i) // Row3-4
+    {
+        taxels[i+33] = CapSense_dsRam.snsList.row3[i].raw[0];
+        taxels[i+39] = CapSense_dsRam.snsList.row4[i].raw[0];
+    }
+    for(unsigned int i=0; i<4; ++i) // Row5-9
+    {
+        taxels[i+45] = CapSense_dsRam.snsList.row5[i].raw[0];
+        taxels[i+49] = CapSense_dsRam.snsList.row6[i].raw[0];
+        taxels[i+53] = CapSense_dsRam.snsList.row7[i].raw[0];
+        taxels[i+57] = CapSense_dsRam.snsList.row8[i].raw[0];
+        taxels[i+61] = CapSense_dsRam.snsList.row9[i].raw[0];
+    }
+}
+
+#define taxelMap map_ProximalFront_V3
+#include "../BICI_Psoc_workspace/ProximalFront_V3.cydsn/taxel_map_table.h"
+#undef taxelMap
+#undef TAXEL_MAP_TABLE_H
+
+// ThumbBack_V3: 47 taxels
+static void copy_ThumbBack_V3(uint16 *taxels)
+{
+    for(unsigned int i=0; i<4; ++i) // Rows0
+    {
+        taxels[i] = CapSense_dsRam.snsList.row0[i].raw[0];
+    }
+    for(unsigned int i=0; i<5; ++i) // Rows1-2-3
+    {
+        taxels[i+4] = CapSense_dsRam.snsList.row1[i].raw[0];
+        taxels[i+9] = CapSense_dsRam.snsList.row2[i].raw[0];
+        taxels[i+14] = CapSense_dsRam.snsList.row3[i].raw[0];
+    }
+    for(unsigned int i=0; i<7; ++i) // Rows4-5
+    {
+        taxels[i+19] = CapSense_dsRam.snsList.row4[i].raw[0];
+        taxels[i+26] = CapSense_dsRam.snsList.row5[i].raw[0];
+    }
+    for(unsigned int i=0; i<4; ++i) // Rows6-7
+    {
+        taxels[i+33] = CapSense_dsRam.snsList.row6[i].raw[0];
+        taxels[i+37] = CapSense_dsRam.snsList.row7[i].raw[0];
+    }
+    for(unsigned int i=0; i<2; ++i) // Rows8-9-10
+    {
+        taxels[i+41] = CapSense_dsRam.snsList.row8[i].raw[0];
+        taxels[i+43] = CapSense_dsRam.snsList.row9[i].raw[0];
+        taxels[i+45] = CapSense_dsRam.snsList.row10[i].raw[0];
+    }
+}
+
+#define taxelMap map_ThumbBack_V3
+#include "../BICI_Psoc_workspace/ThumbBack_V3.cydsn/taxel_map_table.h"
+#undef taxelMap
+#undef TAXEL_MAP_TABLE_H
+
+// ThumbFront_V3: 31 taxels
+static void copy_ThumbFront_V3(uint16 *taxels)
+{
+    for(unsigned int i=0; i<6; ++i) // Rows0
+    {
+        taxels[i] = CapSense_dsRam.snsList.row0[i].raw[0];
+    }
+    for(unsigned int i=0; i<7; ++i) // Rows1-2
+    {
+        taxels[i+6] = CapSense_dsRam.snsList.row1[i].raw[0];
+        taxels[i+13] = CapSense_dsRam.snsList.row2[i].raw[0];
+    }
+    for(unsigned int i=0; i<3; ++i) // Rows3-4-5
+    {
+        taxels[i+20] = CapSense_dsRam.snsList.row3[i].raw[0];
+        taxels[i+23] = CapSense_dsRam.snsList.row4[i].raw[0];
+        taxels[i+26] = CapSense_dsRam.snsList.row5[i].raw[0];
+    }
+    for(unsigned int i=0; i<2; ++i) // Rows6
+    {
+        taxels[i+29] = CapSense_dsRam.snsList.row6[i].raw[0];
+    }
+}
+
+#define taxelMap map_ThumbFront_V3
+#include "../BICI_Psoc_workspace/ThumbFront_V3.cydsn/taxel_map_table.h"
+#undef taxelMap
+#undef TAXEL_MAP_TABLE_H
+
+typedef struct
+{
+    const char *name;
+    void (*copy)(uint16 *taxels);
+    const TaxelMapRun *map;
+    uint8_t nbRuns;
+    uint8_t nbTaxels;
+} NodeCase;
+
+#define NODE(name, nbTaxels) \
+    {#name, copy_##name, map_##name, TAXEL_MAP_SIZE(map_##name), (nbTaxels)}
+
+static const NodeCase nodes[] =
+{
+    NODE(BOH_V3,            118),
+    NODE(Fingertip_V3_acc,   66),
+    NODE(MedialBack_V3,      30),
+    NODE(MedialFront_V3,     27),
+    NODE(Palm_V3,           121),
+    NODE(ProximalBack_V3,    78),
+    NODE(ProximalFront_V3,   65),
+    NODE(ThumbBack_V3,       47),
+    NODE(ThumbFront_V3,      31)
+};
+
+// Give every word of CapSense_dsRam a different value
+static void fillScan(void)
+{
+    uint16 *word = (uint16 *)&CapSense_dsRam;
+    for(size_t i = 0; i < sizeof(CapSense_dsRam) / sizeof(uint16); i++)
+        word[i] = (uint16)(0x1000u + i);
+}
+
+int main(void)
+{
+    uint16 expected[MAX_TAXELS];
+    uint16 taxels[MAX_TAXELS];
+    int failures = 0;
+
+    fillScan();
+
+    for(size_t n = 0; n < sizeof(nodes) / sizeof(nodes[0]); n++) {
+        const NodeCase *node = &nodes[n];
+
+        for(size_t i = 0; i < MAX_TAXELS; i++) {
+            expected[i] = TAXEL_FILLER;
+            taxels[i] = TAXEL_FILLER;
+        }
+
+        node->copy(expected);
+        taxel_map_copy(node->map, node->nbRuns, taxels);
+
+        unsigned copied = 0;
+        int mismatch = -1;
+        for(size_t i = 0; i < MAX_TAXELS; i++) {
+            if(taxels[i] != expected[i] && mismatch < 0)
+                mismatch = (int)i;
+            if(i < node->nbTaxels && expected[i] != TAXEL_FILLER)
+                copied++;
+        }
+
+        if(mismatch >= 0) {
+            printf("%-18s FAIL taxel %d: %#06x instead of %#06x\n", node->name,
+                mismatch, taxels[mismatch], expected[mismatch]);
+            failures++;
+        }
+        else {
+            printf("%-18s ok   %u runs, %u of %u taxels\n", node->name,
+                node->nbRuns, copied, node->nbTaxels);
+        }
+    }
+
+    return failures ? 1 : 0;
+}